@@ -0,0 +1,472 @@
+#ifndef ARCHETYPE_H
+#define ARCHETYPE_H
+
+// ARCHETYPE STORAGE
+// Alternative world layout: entities sharing the same signature are grouped
+// in fixed size chunks, every component type is stored as a column of the chunk
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <new>
+#include <unordered_map>
+
+#include "ECS.h"
+
+#ifndef ARCHETYPE_CHUNK_SIZE
+#define ARCHETYPE_CHUNK_SIZE 16384
+#endif
+
+
+// COMPONENT INFO
+// Type erased operations needed to store a component inside a chunk column
+struct ComponentInfo
+{
+    ComponentType type;
+    size_t size;
+    size_t align;
+    void (*move)(void *dst, void *src);
+    void (*destroy)(void *item);
+};
+
+template<class T> struct ComponentOps
+{
+    // move construct dst from src and destroy src
+    static void move(void *dst, void *src)
+    {
+        T *item = static_cast<T*>(src);
+        new (dst) T(std::move(*item));
+        item->~T();
+    }
+
+    static void destroy(void *item) { static_cast<T*>(item)->~T(); }
+};
+
+class ComponentRegistry : public StaticStorage<std::vector<ComponentInfo>>
+{
+public:
+    template<class T> static const ComponentInfo &info()
+    {
+        ComponentType type(T::type());
+        std::vector<ComponentInfo> &infos = get();
+
+        if(infos.size() <= type)
+            infos.resize(type + 1, ComponentInfo());
+
+        if(infos[type].size == 0) {
+            ComponentInfo info = {type, sizeof(T), alignof(T), &ComponentOps<T>::move, &ComponentOps<T>::destroy};
+            infos[type] = info;
+        }
+
+        return infos[type];
+    }
+
+    static const ComponentInfo &info(ComponentType type) { return get()[type]; }
+};
+
+
+// CHUNK
+// Cache line aligned block of ARCHETYPE_CHUNK_SIZE bytes
+class Chunk
+{
+public:
+    Chunk() : m_memory(new unsigned char[ARCHETYPE_CHUNK_SIZE + ECS_CACHE_LINE]), m_size(0)
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(m_memory.get());
+        address = (address + ECS_CACHE_LINE - 1) & ~static_cast<uintptr_t>(ECS_CACHE_LINE - 1);
+        m_data = reinterpret_cast<unsigned char*>(address);
+    }
+
+    unsigned char *data() { return m_data; }
+
+    size_t size() { return m_size; }
+
+private:
+    friend class Archetype;
+
+    std::unique_ptr<unsigned char[]> m_memory;
+    unsigned char *m_data;
+    size_t m_size;
+};
+
+
+// ARCHETYPE
+// Chunked storage of all the entities sharing one signature
+class Archetype
+{
+public:
+    Archetype(const Signature &signature) : m_signature(signature), m_size(0)
+    {
+        size_t rowSize = sizeof(EntityId);
+        forEachComponent(signature, [this, &rowSize](ComponentType type) {
+            Column column = {ComponentRegistry::info(type), 0};
+            m_columns.push_back(column);
+            rowSize += column.info.size;
+
+            if(m_columnIndex.size() <= type)
+                m_columnIndex.resize(type + 1, size_t(npos));
+            m_columnIndex[type] = m_columns.size() - 1;
+        });
+
+        // shrink the capacity until all the aligned columns fit in a chunk
+        m_capacity = ARCHETYPE_CHUNK_SIZE / rowSize;
+        while(m_capacity > 0 && !layout(m_capacity))
+            m_capacity--;
+
+        assert(m_capacity > 0 && "component too large for an archetype chunk");
+    }
+
+    ~Archetype()
+    {
+        for(size_t row = 0; row < m_size; ++row) {
+            for(Column &column : m_columns)
+                column.info.destroy(component(row, column));
+        }
+
+        for(Chunk *chunk : m_chunks)
+            delete chunk;
+    }
+
+    const Signature &signature() { return m_signature; }
+
+    // number of entities stored
+    size_t size() { return m_size; }
+
+    // number of entities fitting in a chunk
+    size_t capacity() { return m_capacity; }
+
+    std::vector<Chunk*> &chunks() { return m_chunks; }
+
+    bool has(ComponentType type) { return type < m_columnIndex.size() && m_columnIndex[type] != npos; }
+
+    EntityId *entities(Chunk *chunk) { return reinterpret_cast<EntityId*>(chunk->data()); }
+
+    template<class T> T *column(Chunk *chunk)
+    {
+        return reinterpret_cast<T*>(chunk->data() + m_columns[m_columnIndex[T::type()]].offset);
+    }
+
+    EntityId entity(size_t row) { return entities(m_chunks[row / m_capacity])[row % m_capacity]; }
+
+    void *component(size_t row, ComponentType type) { return component(row, m_columns[m_columnIndex[type]]); }
+
+    // append a row for the entity, component slots are left uninitialized
+    size_t addRow(EntityId id)
+    {
+        size_t row = m_size++;
+        if(row / m_capacity == m_chunks.size())
+            m_chunks.push_back(new Chunk());
+
+        Chunk *chunk = m_chunks[row / m_capacity];
+        entities(chunk)[row % m_capacity] = id;
+        chunk->m_size++;
+
+        return row;
+    }
+
+    // remove a row whose components were already moved out or destroyed,
+    // fill the hole with the last row and return the id of the moved entity (0 if none)
+    EntityId removeRow(size_t row)
+    {
+        size_t last = --m_size;
+        Chunk *chunk = m_chunks[last / m_capacity];
+        chunk->m_size--;
+
+        if(row == last)
+            return 0;
+
+        for(Column &column : m_columns)
+            column.info.move(component(row, column), component(last, column));
+
+        EntityId moved = entities(chunk)[last % m_capacity];
+        entities(m_chunks[row / m_capacity])[row % m_capacity] = moved;
+
+        return moved;
+    }
+
+    // cached edges of the archetype transition graph
+    Archetype *&addEdge(ComponentType type) { return edge(m_addEdges, type); }
+    Archetype *&removeEdge(ComponentType type) { return edge(m_removeEdges, type); }
+
+private:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    struct Column {
+        ComponentInfo info;
+        size_t offset;
+    };
+
+    Signature m_signature;
+    std::vector<Column> m_columns;
+    std::vector<size_t> m_columnIndex;
+    std::vector<Chunk*> m_chunks;
+    std::vector<Archetype*> m_addEdges;
+    std::vector<Archetype*> m_removeEdges;
+    size_t m_capacity;
+    size_t m_size;
+
+    void *component(size_t row, Column &column)
+    {
+        return m_chunks[row / m_capacity]->data() + column.offset + (row % m_capacity) * column.info.size;
+    }
+
+    // place the columns after the entity ids, each one aligned to a cache line
+    bool layout(size_t capacity)
+    {
+        size_t offset = capacity * sizeof(EntityId);
+        for(Column &column : m_columns) {
+            size_t align = std::max(column.info.align, static_cast<size_t>(ECS_CACHE_LINE));
+            offset = (offset + align - 1) / align * align;
+            column.offset = offset;
+            offset += capacity * column.info.size;
+        }
+
+        return offset <= ARCHETYPE_CHUNK_SIZE;
+    }
+
+    static Archetype *&edge(std::vector<Archetype*> &edges, ComponentType type)
+    {
+        if(edges.size() <= type)
+            edges.resize(type + 1, nullptr);
+
+        return edges[type];
+    }
+};
+
+
+// ARCHETYPE WORLD
+// Manage entity/component creation and deletion on archetype storage, not thread safe.
+// Handles are generational like the ones of ECS, stale handles are ignored
+class ArchetypeWorld
+{
+public:
+    ArchetypeWorld() { clear(); }
+    ~ArchetypeWorld() { destroyArchetypes(); }
+
+    // number of live entities
+    size_t size() { return m_records.size() - m_free.size() - 1; }
+
+    std::vector<Archetype*> &archetypes() { return m_archetypeList; }
+
+    // false for the invalid entity, deleted ones and out of range handles
+    bool isValid(EntityId id)
+    {
+        EntityId index = entityIndex(id);
+        return index > 0 && index < m_records.size() && m_records[index].archetype &&
+               m_records[index].generation == entityGeneration(id);
+    }
+
+    EntityId createEntity()
+    {
+        EntityId index;
+        if(m_free.empty()) {
+            index = m_records.size();
+            assert(index <= ECS_ENTITY_INDEX_MASK);
+            m_records.push_back(Record());
+        } else {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+
+        Record &record = m_records[index];
+        EntityId id = makeEntity(index, record.generation);
+        record.archetype = m_root;
+        record.row = m_root->addRow(id);
+
+        return id;
+    }
+
+    void deleteEntity(EntityId id)
+    {
+        if(!isValid(id))
+            return;
+
+        Record &record = m_records[entityIndex(id)];
+        forEachComponent(record.archetype->signature(), [&record](ComponentType type) {
+            ComponentRegistry::info(type).destroy(record.archetype->component(record.row, type));
+        });
+
+        removeRow(record.archetype, record.row);
+
+        record.archetype = nullptr;
+        record.generation = (record.generation + 1) & ECS_ENTITY_GENERATION_MASK;
+        m_free.push_back(entityIndex(id));
+    }
+
+    // create a new component and return a temporary handler, nullptr for invalid handles
+    template<class T, typename... Targs> T *createComponent(EntityId id, Targs... args)
+    {
+        if(!isValid(id))
+            return nullptr;
+
+        ComponentType type(T::type());
+        Record &record = m_records[entityIndex(id)];
+
+        if(record.archetype->has(type)) {
+            T *item = static_cast<T*>(record.archetype->component(record.row, type));
+            *item = T(id, args...);
+            return item;
+        }
+
+        ComponentRegistry::info<T>();
+        move(id, transition(record.archetype, type, true));
+
+        return new (record.archetype->component(record.row, type)) T(id, args...);
+    }
+
+    template<class T> void deleteComponent(EntityId id)
+    {
+        if(!isValid(id))
+            return;
+
+        ComponentType type(T::type());
+        Record &record = m_records[entityIndex(id)];
+
+        if(!record.archetype->has(type))
+            return;
+
+        static_cast<T*>(record.archetype->component(record.row, type))->~T();
+        move(id, transition(record.archetype, type, false));
+    }
+
+    // return nullptr if the entity does not own a component of type T or the handle is stale
+    template<class T> T *component(EntityId id)
+    {
+        if(!isValid(id))
+            return nullptr;
+
+        Record &record = m_records[entityIndex(id)];
+        if(!record.archetype->has(T::type()))
+            return nullptr;
+
+        return static_cast<T*>(record.archetype->component(record.row, T::type()));
+    }
+
+    // archetypes containing all the requested components, cached per signature
+    template<class... Args> std::vector<Archetype*> &archetypesWithComponents()
+    {
+        Signature signature(ECS::signature<Args...>());
+
+        auto it = m_queries.find(signature);
+        if(it == m_queries.end()) {
+            it = m_queries.insert(std::make_pair(signature, std::vector<Archetype*>())).first;
+            for(Archetype *archetype : m_archetypeList) {
+                if(matchesSignature(archetype->signature(), signature))
+                    it->second.push_back(archetype);
+            }
+        }
+
+        return it->second;
+    }
+
+    // call f(EntityId, Args&...) for every entity owning all the requested components
+    template<class... Args, class F> void each(F f)
+    {
+        for(Archetype *archetype : archetypesWithComponents<Args...>()) {
+            for(Chunk *chunk : archetype->chunks())
+                eachRow(f, chunk->size(), archetype->entities(chunk), archetype->template column<Args>(chunk)...);
+        }
+    }
+
+    void clear()
+    {
+        destroyArchetypes();
+
+        // index 0 is reserved for invalid entities
+        m_records.assign(1, Record());
+        m_free.clear();
+
+        m_root = archetype(Signature());
+    }
+
+private:
+    struct Record {
+        Record() : archetype(nullptr), row(0), generation(0) {}
+        Archetype *archetype;
+        size_t row;
+        EntityId generation;
+    };
+
+    std::vector<Record> m_records;
+    std::vector<EntityId> m_free;
+    std::unordered_map<Signature, Archetype*> m_archetypes;
+    std::vector<Archetype*> m_archetypeList;
+    std::unordered_map<Signature, std::vector<Archetype*>> m_queries;
+    Archetype *m_root;
+
+    template<class F, class... Args>
+    static void eachRow(F &f, size_t count, EntityId *ids, Args*... columns)
+    {
+        for(size_t i = 0; i < count; ++i)
+            f(ids[i], columns[i]...);
+    }
+
+    Archetype *archetype(const Signature &signature)
+    {
+        auto it = m_archetypes.find(signature);
+        if(it != m_archetypes.end())
+            return it->second;
+
+        Archetype *archetype = new Archetype(signature);
+        m_archetypes[signature] = archetype;
+        m_archetypeList.push_back(archetype);
+
+        for(auto &query : m_queries) {
+            if(matchesSignature(archetype->signature(), query.first))
+                query.second.push_back(archetype);
+        }
+
+        return archetype;
+    }
+
+    // follow the transition graph, creating and caching the edge on first use
+    Archetype *transition(Archetype *from, ComponentType type, bool add)
+    {
+        Archetype *&edge = add ? from->addEdge(type) : from->removeEdge(type);
+
+        if(edge == nullptr) {
+            Signature signature(from->signature());
+            signature.set(type, add);
+
+            edge = archetype(signature);
+        }
+
+        return edge;
+    }
+
+    // move the components shared by both archetypes, slots of new components are left uninitialized
+    void move(EntityId id, Archetype *to)
+    {
+        Record &record = m_records[entityIndex(id)];
+        Archetype *from = record.archetype;
+        size_t row = to->addRow(id);
+
+        forEachComponent(from->signature(), [&](ComponentType type) {
+            if(to->has(type))
+                ComponentRegistry::info(type).move(to->component(row, type), from->component(record.row, type));
+        });
+
+        removeRow(from, record.row);
+
+        record.archetype = to;
+        record.row = row;
+    }
+
+    void removeRow(Archetype *archetype, size_t row)
+    {
+        EntityId moved = archetype->removeRow(row);
+        if(moved)
+            m_records[entityIndex(moved)].row = row;
+    }
+
+    void destroyArchetypes()
+    {
+        for(Archetype *archetype : m_archetypeList)
+            delete archetype;
+
+        m_archetypes.clear();
+        m_archetypeList.clear();
+        m_queries.clear();
+    }
+};
+
+#endif // ARCHETYPE_H
@@ -0,0 +1,38 @@
+TEMPLATE = app
+TARGET = benchmarks
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+CONFIG -= qt
+
+# keep multiply and add separately rounded, see Simd.h
+QMAKE_CXXFLAGS += -ffp-contract=off
+
+INCLUDEPATH += .
+
+LIBS += -lpthread
+
+SOURCES += \
+    Benchmarks/main.cpp \
+    Benchmarks/ArchetypeBenchmark.cpp \
+    Benchmarks/BroadphaseBenchmark.cpp \
+    Benchmarks/EventBenchmark.cpp \
+    Benchmarks/IndexBenchmark.cpp \
+    Benchmarks/IntegrateBenchmark.cpp \
+    Benchmarks/LayoutBenchmark.cpp \
+    Benchmarks/SnapshotBenchmark.cpp \
+    Benchmarks/SpawnBenchmark.cpp \
+    Benchmarks/WorldBenchmark.cpp
+
+HEADERS += \
+    Benchmarks/Benchmark.h \
+    ECS.h \
+    Components/PhysicsComponent.h \
+    Components/GraphicComponent.h \
+    Components/MagneticComponent.h \
+    Components/HealthComponent.h \
+    Components/LightComponent.h \
+    Systems/SpatialHash.h \
+    Archetype.h \
+    Simd.h \
+    Snapshot.h
@@ -0,0 +1,136 @@
+#include "Benchmark.h"
+
+#include <random>
+
+#include "ECS.h"
+#include "Archetype.h"
+#include "Components/PhysicsComponent.h"
+#include "Components/GraphicComponent.h"
+#include "Components/MagneticComponent.h"
+#include "Components/HealthComponent.h"
+#include "Components/LightComponent.h"
+
+// sparse set containers of ECS
+struct SparseSetLayout
+{
+    static const char *name() { return "sparse set"; }
+
+    EntityId createEntity() { return ECS::createEntity(); }
+
+    template<class T> void createComponent(EntityId id) { ECS::createComponent<T>(id); }
+
+    template<class T> void deleteComponent(EntityId id) { ECS::deleteComponent<T>(id); }
+
+    template<class... Args, class F> void each(F f) { ECS::view<const Args...>().each(f); }
+
+    void clear() { ECS::cleanUp(); }
+};
+
+// chunks of the entities sharing a signature
+struct ArchetypeLayout
+{
+    static const char *name() { return "archetype"; }
+
+    EntityId createEntity() { return world.createEntity(); }
+
+    template<class T> void createComponent(EntityId id) { world.createComponent<T>(id); }
+
+    template<class T> void deleteComponent(EntityId id) { world.deleteComponent<T>(id); }
+
+    template<class... Args, class F> void each(F f) { world.each<Args...>(f); }
+
+    void clear() { world.clear(); }
+
+    ArchetypeWorld world;
+};
+
+// entities matched by the 2 and 3 type queries, the layouts must agree
+struct Matches {
+    size_t bodies, lights;
+};
+
+// every entity is a physics body, half of them are drawn and half have health, one in
+// four is lit and one in ten magnetic, the components are added one at a time
+template<class Layout> static Matches workload(Layout &layout, size_t entities)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s %zuk", Layout::name(), entities / 1000);
+
+    std::mt19937 random(42);
+    std::vector<EntityId> ids, lit;
+
+    double seconds = Benchmark::measure([&] {
+        for(size_t i = 0; i < entities; ++i) {
+            EntityId id = layout.createEntity();
+            ids.push_back(id);
+
+            layout.template createComponent<PhysicsComponent>(id);
+            if(random() % 2 == 0)
+                layout.template createComponent<GraphicComponent>(id);
+            if(random() % 2 == 0)
+                layout.template createComponent<HealthComponent>(id);
+            if(random() % 4 == 0) {
+                layout.template createComponent<LightComponent>(id);
+                lit.push_back(id);
+            }
+            if(random() % 10 == 0)
+                layout.template createComponent<MagneticComponent>(id);
+        }
+    });
+    Benchmark::report(name, "spawn", entities, seconds);
+
+    // an archetype layout moves the whole entity to another chunk on every change
+    seconds = Benchmark::measure([&] {
+        for(EntityId id : lit)
+            layout.template deleteComponent<LightComponent>(id);
+    });
+    Benchmark::report(name, "remove", lit.size(), seconds);
+
+    seconds = Benchmark::measure([&] {
+        for(EntityId id : lit)
+            layout.template createComponent<LightComponent>(id);
+    });
+    Benchmark::report(name, "add", lit.size(), seconds);
+
+    Matches matches{0, 0};
+    float sum = 0.0f;
+
+    seconds = Benchmark::measure([&] {
+        layout.template each<PhysicsComponent, HealthComponent>([&](EntityId, const auto &p, const auto &h) {
+            sum += p.mass + h.health;
+            matches.bodies++;
+        });
+    });
+    Benchmark::report(name, "query 2 types", matches.bodies, seconds);
+
+    seconds = Benchmark::measure([&] {
+        layout.template each<GraphicComponent, LightComponent, MagneticComponent>(
+            [&](EntityId, const auto &, const auto &l, const auto &) {
+                sum += l.intensity;
+                matches.lights++;
+            });
+    });
+    Benchmark::report(name, "query 3 types", matches.lights, seconds);
+
+    if(sum != 0.0f)
+        printf("%s: queries read uninitialized values\n", name);
+
+    layout.clear();
+    return matches;
+}
+
+// the same spawn, add/remove and query workload on the sparse set and archetype layouts
+BENCHMARK(archetype)
+{
+    for(size_t entities : {size_t(100000), size_t(1000000)}) {
+        SparseSetLayout sparseSet;
+        Matches a = workload(sparseSet, entities);
+
+        ArchetypeLayout archetype;
+        Matches b = workload(archetype, entities);
+
+        if(a.bodies != b.bodies || a.lights != b.lights)
+            printf("archetype: the layouts matched %zu/%zu and %zu/%zu entities\n",
+                   a.bodies, a.lights, b.bodies, b.lights);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// BENCHMARK
+// Minimal benchmark registry, every benchmark registers itself and is run by main. The
+// reported results are printed and collected to be written as JSON
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::function<void()> BenchmarkFunction;
+
+class Benchmark
+{
+public:
+    Benchmark(const char *name, BenchmarkFunction function) { benchmarks().push_back(Entry(name, function)); }
+
+    static void runAll(const std::string &filter)
+    {
+        for(Entry &entry : benchmarks()) {
+            if(filter.empty() || entry.first.find(filter) != std::string::npos)
+                entry.second();
+        }
+    }
+
+    // seconds spent running f
+    template<class F> static double measure(F f)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static void report(const char *benchmark, const char *variant, size_t items, double seconds)
+    {
+        printf("%-24s %-16s %10zu items %10.3f ms %14.0f items/s\n",
+               benchmark, variant, items, seconds * 1000.0, items / seconds);
+
+        results().push_back(Result{benchmark, variant, items, seconds, 0.0, ""});
+    }
+
+    // a measure other than throughput, like memory or latency
+    static void value(const char *benchmark, const char *variant, double value, const char *unit)
+    {
+        printf("%-24s %-16s %14.2f %s\n", benchmark, variant, value, unit);
+
+        results().push_back(Result{benchmark, variant, 0, 0.0, value, unit});
+    }
+
+    static bool writeJson(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if(!file)
+            return false;
+
+        fprintf(file, "{\n  \"results\": [");
+        for(size_t i = 0; i < results().size(); ++i) {
+            const Result &result = results()[i];
+
+            fprintf(file, "%s\n    {\"benchmark\": \"%s\", \"variant\": \"%s\", ",
+                    i ? "," : "", result.benchmark.c_str(), result.variant.c_str());
+            if(result.unit.empty())
+                fprintf(file, "\"items\": %zu, \"seconds\": %.9f, \"items_per_second\": %.1f}",
+                        result.items, result.seconds, result.items / result.seconds);
+            else
+                fprintf(file, "\"value\": %.6f, \"unit\": \"%s\"}", result.value, result.unit.c_str());
+        }
+        fprintf(file, "\n  ]\n}\n");
+
+        return fclose(file) == 0;
+    }
+
+private:
+    typedef std::pair<std::string, BenchmarkFunction> Entry;
+
+    struct Result {
+        std::string benchmark;
+        std::string variant;
+        size_t items;
+        double seconds;
+        double value;
+        std::string unit;
+    };
+
+    static std::vector<Result> &results()
+    {
+        static std::vector<Result> entries;
+        return entries;
+    }
+
+    static std::vector<Entry> &benchmarks()
+    {
+        static std::vector<Entry> entries;
+        return entries;
+    }
+};
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static Benchmark name##Benchmark(#name, name); \
+    static void name()
+
+#endif // BENCHMARK_H
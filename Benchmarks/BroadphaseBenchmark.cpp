@@ -0,0 +1,108 @@
+#include "Benchmark.h"
+
+#include <cmath>
+#include <random>
+
+#include "ECS.h"
+#include "Systems/SpatialHash.h"
+
+// bodies of radius 0.5, uniform in a cube of volume 8 per body or in 16 gaussian clusters
+// in the same cube
+static std::vector<glm::vec3> bodies(size_t count, bool clustered, std::mt19937 &random)
+{
+    const float side = 2.0f * std::cbrt(float(count));
+
+    std::uniform_real_distribution<float> uniform(0.0f, side);
+    std::normal_distribution<float> normal(0.0f, side / 16.0f);
+
+    std::vector<glm::vec3> centers(16);
+    for(glm::vec3 &center : centers)
+        center = glm::vec3(uniform(random), uniform(random), uniform(random));
+
+    std::vector<glm::vec3> positions(count);
+    for(glm::vec3 &position : positions) {
+        if(clustered)
+            position = centers[random() % centers.size()] + glm::vec3(normal(random), normal(random), normal(random));
+        else
+            position = glm::vec3(uniform(random), uniform(random), uniform(random));
+    }
+
+    return positions;
+}
+
+static size_t bruteForcePairs(const std::vector<glm::vec3> &positions)
+{
+    size_t pairs = 0;
+    for(size_t i = 0; i < positions.size(); ++i) {
+        for(size_t j = i + 1; j < positions.size(); ++j) {
+            glm::vec3 d = positions[i] - positions[j];
+            pairs += d.x*d.x + d.y*d.y + d.z*d.z < 1.0f;
+        }
+    }
+
+    return pairs;
+}
+
+// rebuilding, incremental moves of a tenth of the bodies and pair generation of the
+// spatial hash broadphase
+BENCHMARK(broadphase)
+{
+    for(bool clustered : {false, true}) {
+        const char *distribution = clustered ? "clustered" : "uniform";
+
+        // the pairs found must match the quadratic test on a small set
+        std::mt19937 random(42);
+        std::vector<glm::vec3> positions = bodies(2000, clustered, random);
+
+        SpatialHash check(ECS::threadPool(), 0.5f);
+        for(size_t i = 0; i < positions.size(); ++i)
+            check.update(EntityId(i + 1), positions[i]);
+
+        {
+            ArenaVector<CollisionPair> pairs;
+            check.pairs(pairs);
+            if(pairs.size() != bruteForcePairs(positions) || std::unique(pairs.begin(), pairs.end()) != pairs.end())
+                printf("broadphase: %s found %zu pairs, expected %zu\n", distribution, pairs.size(), bruteForcePairs(positions));
+        }
+
+        for(size_t count : {size_t(100000), size_t(1000000)}) {
+            positions = bodies(count, clustered, random);
+            SpatialHash hash(ECS::threadPool(), 0.5f);
+
+            double seconds = Benchmark::measure([&] {
+                for(size_t i = 0; i < positions.size(); ++i)
+                    hash.update(EntityId(i + 1), positions[i]);
+            });
+            Benchmark::report("broadphase", clustered ? "clustered build" : "uniform build", count, seconds);
+
+            std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+            std::vector<size_t> moved;
+            for(size_t i = 0; i < count; ++i) {
+                if(random() % 10 == 0) {
+                    moved.push_back(i);
+                    positions[i] += glm::vec3(step(random), step(random), step(random));
+                }
+            }
+
+            seconds = Benchmark::measure([&] {
+                for(size_t i : moved)
+                    hash.update(EntityId(i + 1), positions[i]);
+            });
+            Benchmark::report("broadphase", clustered ? "clustered move" : "uniform move", moved.size(), seconds);
+
+            size_t found = 0;
+            seconds = Benchmark::measure([&] {
+                ArenaVector<CollisionPair> pairs;
+                hash.pairs(pairs);
+                found = pairs.size();
+            });
+            Benchmark::report("broadphase", clustered ? "clustered pairs" : "uniform pairs", count, seconds);
+            Benchmark::value("broadphase", distribution, found, "pairs");
+            Benchmark::value("broadphase", distribution, hash.cells(), "cells");
+
+            ECS::frameArena().swap();
+        }
+
+        ECS::frameArena().swap();
+    }
+}
@@ -0,0 +1,146 @@
+#include "Benchmark.h"
+
+#include <thread>
+
+#include "ECS.h"
+
+class BenchmarkEvent : public Event<BenchmarkEvent>
+{
+public:
+    BenchmarkEvent(int _value) : value(_value) {}
+    int value;
+};
+
+// the first event thread: one allocation, lock and notification per published event,
+// the consumer takes the lock again for every event and counts it as delivered
+class LockedEventThread
+{
+public:
+    LockedEventThread() : m_delivered(0), m_running(true), m_thread(&LockedEventThread::run, this) {}
+    ~LockedEventThread()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            m_running = false;
+        }
+        cv.notify_one();
+        m_thread.join();
+    }
+
+    void publish(int value)
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            m_events.push(new BenchmarkEvent(value));
+        }
+        cv.notify_one();
+    }
+
+    // delivered events since the last call
+    size_t receive() { return m_delivered.exchange(0); }
+
+private:
+    std::atomic<size_t> m_delivered;
+    bool m_running;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::queue<BaseEvent*> m_events;
+    std::thread m_thread;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+
+        while(m_running || !m_events.empty()) {
+            cv.wait(lk, [this] { return !m_events.empty() || !m_running; });
+
+            while(!m_events.empty()) {
+                BaseEvent *event = m_events.front();
+                m_events.pop();
+                std::shared_ptr<BaseEvent> delivered(event);
+                m_delivered++;
+            }
+        }
+    }
+};
+
+// pooled channel events received by cursor
+class ChannelEventThread
+{
+public:
+    ChannelEventThread()
+    {
+        m_thread.setDelivery(EventThread::Threaded);
+        m_thread.addSubscription<BenchmarkEvent>(&m_listener);
+    }
+    ~ChannelEventThread() { m_thread.removeAllSubscriptions(&m_listener); }
+
+    void publish(int value) { m_thread.publish<BenchmarkEvent>(value); }
+
+    size_t receive()
+    {
+        size_t count = m_thread.receiveEvents(&m_listener).size();
+        m_thread.releaseEvents(&m_listener);
+        return count;
+    }
+
+private:
+    EventThread m_thread;
+    EventListener m_listener;
+};
+
+// publish events from producers threads, wait until all of them are delivered
+template<class Thread> static void publish(Thread &thread, const char *variant, int producers)
+{
+    const size_t events = 1 << 18;
+    const size_t perProducer = events / producers;
+
+    std::vector<double> latencies(producers);
+    std::vector<std::thread> threads;
+    size_t count = 0;
+
+    double seconds = Benchmark::measure([&] {
+        for(int p = 0; p < producers; ++p) {
+            threads.push_back(std::thread([&, p] {
+                double elapsed = Benchmark::measure([&] {
+                    for(size_t i = 0; i < perProducer; ++i)
+                        thread.publish(int(i));
+                });
+                latencies[p] = elapsed / perProducer;
+            }));
+        }
+
+        for(std::thread &t : threads)
+            t.join();
+
+        while(count < perProducer * producers) {
+            count += thread.receive();
+            std::this_thread::yield();
+        }
+    });
+
+    double latency = 0.0;
+    for(double l : latencies)
+        latency += l / producers;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s x%d", variant, producers);
+    Benchmark::report("events", name, count, seconds);
+    Benchmark::value("events", name, latency * 1e9, "ns/publish");
+}
+
+// sustained throughput and publish latency of the event thread with 1-32 producers
+BENCHMARK(events)
+{
+    for(int producers = 1; producers <= 32; producers *= 2) {
+        {
+            LockedEventThread thread;
+            publish(thread, "locked", producers);
+        }
+
+        // the second run reuses the slots pooled by the first one
+        ChannelEventThread thread;
+        publish(thread, "channel", producers);
+        publish(thread, "channel pooled", producers);
+    }
+}
@@ -0,0 +1,63 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <random>
+
+#include "ECS.h"
+#include "Components/PhysicsComponent.h"
+#include "Components/HealthComponent.h"
+#include "Components/LightComponent.h"
+
+static void reportMemory(const char *variant, size_t entities, size_t bytes)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s %zuk", variant, entities / 1000);
+    Benchmark::value("index", name, bytes / (1024.0 * 1024.0), "MB");
+    Benchmark::value("index", name, double(bytes) / entities, "bytes/entity");
+}
+
+// memory of the entity to component indices and speed of component lookups, every entity
+// has a physics and a health component, one in ten a light component
+BENCHMARK(sparseIndex)
+{
+    for(size_t entities : {size_t(1000000), size_t(10000000)}) {
+        std::mt19937 random(42);
+
+        std::vector<EntityId> ids = ECS::createEntities(entities);
+        std::vector<EntityId> lit;
+        for(EntityId id : ids) {
+            if(random() % 10 == 0)
+                lit.push_back(id);
+        }
+
+        ECS::createComponents<PhysicsComponent>(ids);
+        ECS::createComponents<HealthComponent>(ids);
+        ECS::createComponents<LightComponent>(lit);
+
+        size_t bytes = ECS::componentContainer<PhysicsComponent>()->indexMemory() +
+                       ECS::componentContainer<HealthComponent>()->indexMemory() +
+                       ECS::componentContainer<LightComponent>()->indexMemory();
+        reportMemory("3 types", entities, bytes);
+
+        // lookups in id order and in random order, half of them miss the light component
+        float sum = 0.0f;
+        double seconds = Benchmark::measure([&] {
+            for(EntityId id : ids)
+                sum += ECS::component<HealthComponent>(id)->health;
+        });
+        Benchmark::report("index", "sequential", entities, seconds);
+
+        std::shuffle(ids.begin(), ids.end(), random);
+        size_t found = 0;
+        seconds = Benchmark::measure([&] {
+            for(EntityId id : ids)
+                found += ECS::component<LightComponent>(id) != nullptr;
+        });
+        Benchmark::report("index", "random", entities, seconds);
+
+        if(found != lit.size() || sum != 0.0f)
+            printf("index: lookups found %zu of %zu lights\n", found, lit.size());
+
+        ECS::cleanUp();
+    }
+}
@@ -0,0 +1,43 @@
+#include "Benchmark.h"
+
+#include <cstring>
+#include <random>
+
+#include "Simd.h"
+
+// entities per second of the integration kernels on position/velocity columns
+BENCHMARK(integrate)
+{
+    const size_t entities = 1000000;
+    const size_t count = entities * 3;
+    const int frames = 20;
+    const float dt = 1.0f/60.0f;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    std::vector<float> initial(count), velocities(count);
+    for(size_t i = 0; i < count; ++i) {
+        initial[i] = distribution(random);
+        velocities[i] = distribution(random);
+    }
+
+    std::vector<float> reference(initial);
+    for(int frame = 0; frame < frames; ++frame)
+        Simd::integrateScalar(reference.data(), velocities.data(), count, dt);
+
+    for(int level = Simd::Scalar; level <= Simd::detect(); ++level) {
+        IntegrateKernel kernel = Simd::integrateKernel(static_cast<Simd::Level>(level));
+        std::vector<float> positions(initial);
+
+        double seconds = Benchmark::measure([&] {
+            for(int frame = 0; frame < frames; ++frame)
+                kernel(positions.data(), velocities.data(), count, dt);
+        });
+
+        Benchmark::report("integrate", Simd::name(static_cast<Simd::Level>(level)), entities * frames, seconds);
+
+        if(memcmp(positions.data(), reference.data(), count * sizeof(float)) != 0)
+            printf("integrate: %s kernel is not bit exact with the scalar one\n", Simd::name(static_cast<Simd::Level>(level)));
+    }
+}
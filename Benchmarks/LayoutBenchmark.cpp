@@ -0,0 +1,94 @@
+#include "Benchmark.h"
+
+#include <random>
+
+#include "ECS.h"
+#include "Simd.h"
+#include "Components/PhysicsComponent.h"
+
+// same fields of PhysicsComponent, stored packed
+class PackedPhysicsComponent : public Component<PackedPhysicsComponent>
+{
+public:
+    PackedPhysicsComponent(EntityId id = 0) : Component(id) {}
+    glm::vec3 velocity;
+    glm::vec3 position;
+    float mass = 0.0f;
+};
+
+static void reportBandwidth(const char *variant, size_t bytes, int frames, double seconds)
+{
+    Benchmark::value("layout", variant, bytes / 1e6, "MB/frame");
+    Benchmark::value("layout", variant, bytes * frames / seconds / 1e9, "GB/s");
+}
+
+// position integration over packed and column storage of the physics components
+BENCHMARK(layout)
+{
+    const size_t entities = 1000000;
+    const int frames = 20;
+    const float dt = 1.0f/60.0f;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    PackedStorage<PackedPhysicsComponent> packed;
+    ColumnStorage<PhysicsComponent> columns;
+
+    for(size_t i = 0; i < entities; ++i) {
+        PhysicsComponent p(i + 1);
+        p.velocity = glm::vec3(distribution(random), distribution(random), distribution(random));
+        p.position = glm::vec3(distribution(random), distribution(random), distribution(random));
+        p.mass = distribution(random);
+        columns.push_back(p);
+
+        PackedPhysicsComponent q(i + 1);
+        q.velocity = p.velocity;
+        q.position = p.position;
+        q.mass = p.mass;
+        packed.push_back(q);
+    }
+
+    // whole components are pulled into cache and written back
+    size_t packedBytes = entities * sizeof(PackedPhysicsComponent) * 2;
+    // velocity is read, position is read and written
+    size_t columnBytes = entities * sizeof(glm::vec3) * 3;
+
+    double seconds = Benchmark::measure([&] {
+        for(int frame = 0; frame < frames; ++frame) {
+            for(PackedPhysicsComponent &p : packed.items())
+                p.position += dt*p.velocity;
+        }
+    });
+    Benchmark::report("layout", "packed", entities * frames, seconds);
+    reportBandwidth("packed", packedBytes, frames, seconds);
+
+    seconds = Benchmark::measure([&] {
+        for(int frame = 0; frame < frames; ++frame) {
+            for(size_t i = 0; i < columns.size(); ++i) {
+                PhysicsComponent::Ref p = columns[i];
+                p.position += dt*p.velocity;
+            }
+        }
+    });
+    Benchmark::report("layout", "columns", entities * frames, seconds);
+    reportBandwidth("columns", columnBytes, frames, seconds);
+
+    // both layouts must hold the same positions
+    for(size_t i = 0; i < entities; ++i) {
+        if(!(packed.items()[i].position == columns[i].position)) {
+            printf("layout: packed and column positions differ at %zu\n", i);
+            break;
+        }
+    }
+
+    float *positions = reinterpret_cast<float*>(columns.column(&PhysicsComponent::position));
+    const float *velocities = reinterpret_cast<float*>(columns.column(&PhysicsComponent::velocity));
+
+    seconds = Benchmark::measure([&] {
+        for(int frame = 0; frame < frames; ++frame)
+            Simd::integrate(positions, velocities, entities * 3, dt);
+    });
+    Benchmark::report("layout", "columns simd", entities * frames, seconds);
+    reportBandwidth("columns simd", columnBytes, frames, seconds);
+}
@@ -0,0 +1,79 @@
+#include "Benchmark.h"
+
+#include <cstdio>
+#include <random>
+
+#include "ECS.h"
+#include "Snapshot.h"
+#include "Components/PhysicsComponent.h"
+#include "Components/GraphicComponent.h"
+#include "Components/HealthComponent.h"
+#include "Components/LightComponent.h"
+
+static bool saveWorld(const std::string &path)
+{
+    return Snapshot::save<PhysicsComponent, GraphicComponent, HealthComponent, LightComponent>(path);
+}
+
+static bool loadWorld(const std::string &path)
+{
+    return Snapshot::load<PhysicsComponent, GraphicComponent, HealthComponent, LightComponent>(path);
+}
+
+// rebuilding a world entity by entity against saving it and loading it back, every entity
+// is a physics body, half of them are drawn and have health, one in four is lit
+BENCHMARK(snapshot)
+{
+    const std::string path = "snapshot_benchmark.bin";
+
+    for(size_t entities : {size_t(100000), size_t(1000000)}) {
+        char name[32];
+        snprintf(name, sizeof(name), "snapshot %zuk", entities / 1000);
+
+        std::mt19937 random(42);
+        std::vector<bool> graphic, health, light;
+        for(size_t i = 0; i < entities; ++i) {
+            graphic.push_back(random() % 2 == 0);
+            health.push_back(random() % 2 == 0);
+            light.push_back(random() % 4 == 0);
+        }
+
+        // the query is registered first, like the ones of the systems
+        EntitySet *bodies = ECS::entitiesWithComponents<PhysicsComponent, HealthComponent>();
+
+        double seconds = Benchmark::measure([&] {
+            for(size_t i = 0; i < entities; ++i) {
+                EntityId id = ECS::createEntity();
+                ECS::createComponent<PhysicsComponent>(id);
+                if(graphic[i])
+                    ECS::createComponent<GraphicComponent>(id);
+                if(health[i])
+                    ECS::createComponent<HealthComponent>(id, 5.0f);
+                if(light[i])
+                    ECS::createComponent<LightComponent>(id);
+            }
+        });
+        Benchmark::report(name, "create", entities, seconds);
+
+        size_t matching = bodies->size();
+
+        bool saved = false;
+        seconds = Benchmark::measure([&] { saved = saveWorld(path); });
+        Benchmark::report(name, "save", entities, seconds);
+
+        ECS::cleanUp();
+        bodies = ECS::entitiesWithComponents<PhysicsComponent, HealthComponent>();
+
+        bool loaded = false;
+        seconds = Benchmark::measure([&] { loaded = loadWorld(path); });
+        Benchmark::report(name, "load", entities, seconds);
+
+        if(!saved || !loaded)
+            printf("%s: %s\n", name, Snapshot::error().c_str());
+        else if(bodies->size() != matching || ECS::componentContainer<PhysicsComponent>()->size() != entities)
+            printf("%s: %zu of %zu bodies with health loaded\n", name, bodies->size(), matching);
+
+        ECS::cleanUp();
+        remove(path.c_str());
+    }
+}
@@ -0,0 +1,46 @@
+#include "Benchmark.h"
+
+#include "ECS.h"
+#include "Components/PhysicsComponent.h"
+#include "Components/GraphicComponent.h"
+#include "Components/MagneticComponent.h"
+#include "Components/HealthComponent.h"
+#include "Components/LightComponent.h"
+
+static void registerQueries()
+{
+    ECS::entitiesWithComponents<GraphicComponent, PhysicsComponent>();
+    ECS::entitiesWithComponents<HealthComponent>();
+}
+
+// entities with 5 components created one at a time and in bulk
+BENCHMARK(spawn)
+{
+    const size_t entities = 1000000;
+
+    registerQueries();
+    double seconds = Benchmark::measure([&] {
+        for(size_t i = 0; i < entities; ++i) {
+            EntityId id = ECS::createEntity();
+            ECS::createComponent<GraphicComponent>(id);
+            ECS::createComponent<MagneticComponent>(id);
+            ECS::createComponent<HealthComponent>(id, 5);
+            ECS::createComponent<LightComponent>(id);
+            ECS::createComponent<PhysicsComponent>(id);
+        }
+    });
+    Benchmark::report("spawn", "single", entities, seconds);
+    ECS::cleanUp();
+
+    registerQueries();
+    seconds = Benchmark::measure([&] {
+        std::vector<EntityId> ids = ECS::createEntities(entities);
+        ECS::createComponents<GraphicComponent>(ids);
+        ECS::createComponents<MagneticComponent>(ids);
+        ECS::createComponents<HealthComponent>(ids, [](HealthComponent &h) { h.health = 5; });
+        ECS::createComponents<LightComponent>(ids);
+        ECS::createComponents<PhysicsComponent>(ids);
+    });
+    Benchmark::report("spawn", "bulk", entities, seconds);
+    ECS::cleanUp();
+}
@@ -0,0 +1,191 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <random>
+
+#include "ECS.h"
+#include "Components/PhysicsComponent.h"
+#include "Components/GraphicComponent.h"
+#include "Components/MagneticComponent.h"
+#include "Components/HealthComponent.h"
+#include "Components/LightComponent.h"
+
+class WorldEvent : public Event<WorldEvent>
+{
+public:
+    WorldEvent(EntityId _id) : id(_id) {}
+    EntityId id;
+};
+
+class WorldSystem : public System<WorldSystem>
+{
+public:
+    WorldSystem() : received(0) { subscribeTo<WorldEvent>(); }
+
+    void handleEvent(BaseEvent *) { received++; }
+
+    size_t received;
+};
+
+// mixed signatures: every entity is a physics body, half of them are drawn and half have
+// health, one in four is lit and one in ten magnetic
+struct World {
+    std::vector<EntityId> all, graphic, health, light, magnetic;
+
+    World(const std::vector<EntityId> &ids, std::mt19937 &random) : all(ids)
+    {
+        for(EntityId id : ids) {
+            if(random() % 2 == 0)
+                graphic.push_back(id);
+            if(random() % 2 == 0)
+                health.push_back(id);
+            if(random() % 4 == 0)
+                light.push_back(id);
+            if(random() % 10 == 0)
+                magnetic.push_back(id);
+        }
+    }
+
+    void createComponents()
+    {
+        ECS::createComponents<PhysicsComponent>(all);
+        ECS::createComponents<GraphicComponent>(graphic);
+        ECS::createComponents<HealthComponent>(health, [](HealthComponent &h) { h.health = 5; });
+        ECS::createComponents<LightComponent>(light);
+        ECS::createComponents<MagneticComponent>(magnetic);
+    }
+};
+
+template<class... Args> static void query(const char *benchmark, const char *variant)
+{
+    float sum = 0.0f;
+    size_t count = 0;
+
+    double seconds = Benchmark::measure([&] {
+        for(EntityId id : *ECS::entitiesWithComponents<Args...>()) {
+            sum += ECS::component<const PhysicsComponent>(id)->mass;
+            count++;
+        }
+    });
+    Benchmark::report(benchmark, variant, count, seconds);
+
+    if(sum != 0.0f)
+        printf("%s: %s read uninitialized masses\n", benchmark, variant);
+}
+
+// bulk adds to the handles of deleted entities, half of their indices recycled, must not
+// reach the new entities nor leave orphan components
+static void staleHandles(const char *benchmark, const std::vector<EntityId> &deleted)
+{
+    std::vector<EntityId> stale(deleted.begin(), deleted.begin() + std::min(deleted.size(), size_t(1000)));
+    std::vector<EntityId> recycled = ECS::createEntities(stale.size() / 2);
+
+    EntitySet *query = ECS::entitiesWithComponents<HealthComponent>();
+    ECS::createComponents<HealthComponent>(stale);
+
+    size_t leaked = 0;
+    for(EntityId id : recycled)
+        leaked += ECS::entities()[id].test(HealthComponent::type());
+
+    size_t orphans = ECS::componentContainer<HealthComponent>()->size();
+    if(leaked != 0 || orphans != 0 || !query->empty())
+        printf("%s: bulk add to %zu stale handles set %zu signatures, stored %zu components, matched %zu\n",
+               benchmark, stale.size(), leaked, orphans, query->size());
+
+    for(EntityId id : recycled)
+        ECS::deleteEntity(id);
+}
+
+// events published in frames of at most 64k, flushed and dispatched to a system
+static void events(const char *benchmark, size_t count)
+{
+    const size_t frame = 1 << 16;
+    WorldSystem *system = ECS::createSystem<WorldSystem>();
+
+    double seconds = Benchmark::measure([&] {
+        for(size_t published = 0; published < count; published += frame) {
+            for(size_t i = published; i < std::min(count, published + frame); ++i)
+                EventProducer::publishEvent<WorldEvent>(EntityId(i));
+
+            ECS::flushEvents();
+            ECS::events().drain();
+            system->processEvents();
+            ECS::endFrame();
+        }
+    });
+    Benchmark::report(benchmark, "events", count, seconds);
+
+    if(system->received != count)
+        printf("%s: %zu of %zu events received\n", benchmark, system->received, count);
+
+    ECS::deleteSystem<WorldSystem>();
+}
+
+// structural changes, queries, lookups and events over worlds of 10k to 10M entities
+BENCHMARK(world)
+{
+    for(size_t entities = 10000; entities <= 10000000; entities *= 10) {
+        std::mt19937 random(42);
+
+        char name[32];
+        if(entities < 1000000)
+            snprintf(name, sizeof(name), "world %zuk", entities / 1000);
+        else
+            snprintf(name, sizeof(name), "world %zuM", entities / 1000000);
+
+        double seconds = Benchmark::measure([&] {
+            for(size_t i = 0; i < entities; ++i)
+                ECS::createEntity();
+        });
+        Benchmark::report(name, "create", entities, seconds);
+        ECS::cleanUp();
+
+        std::vector<EntityId> ids;
+        seconds = Benchmark::measure([&] { ids = ECS::createEntities(entities); });
+        Benchmark::report(name, "create bulk", entities, seconds);
+
+        World world(ids, random);
+        size_t components = world.all.size() + world.graphic.size() + world.health.size() +
+                            world.light.size() + world.magnetic.size();
+
+        // the queries are registered first so that adding components keeps them updated
+        ECS::entitiesWithComponents<PhysicsComponent, HealthComponent>();
+        ECS::entitiesWithComponents<GraphicComponent, LightComponent, MagneticComponent>();
+
+        seconds = Benchmark::measure([&] { world.createComponents(); });
+        Benchmark::report(name, "add mixed", components, seconds);
+
+        query<PhysicsComponent, HealthComponent>(name, "query 2 types");
+        query<GraphicComponent, LightComponent, MagneticComponent>(name, "query 3 types");
+
+        std::shuffle(ids.begin(), ids.end(), random);
+        float sum = 0.0f;
+        seconds = Benchmark::measure([&] {
+            for(EntityId id : ids)
+                sum += ECS::component<const PhysicsComponent>(id)->mass;
+        });
+        Benchmark::report(name, "random access", entities, seconds);
+
+        seconds = Benchmark::measure([&] {
+            for(EntityId id : world.light)
+                ECS::deleteComponent<LightComponent>(id);
+        });
+        Benchmark::report(name, "remove", world.light.size(), seconds);
+
+        seconds = Benchmark::measure([&] {
+            for(EntityId id : ids)
+                ECS::deleteEntity(id);
+        });
+        Benchmark::report(name, "delete", entities, seconds);
+
+        size_t left = ECS::componentContainer<PhysicsComponent>()->size();
+        if(sum != 0.0f || left != 0)
+            printf("%s: %zu physics components left after deleting all entities\n", name, left);
+
+        staleHandles(name, ids);
+
+        events(name, std::min(entities, size_t(1000000)));
+
+        ECS::cleanUp();
+    }
+}
@@ -0,0 +1,25 @@
+#include "Benchmark.h"
+
+#include <cstring>
+
+// usage: benchmarks [filter] [--json file]
+int main(int argc, char **argv)
+{
+    std::string filter, json;
+
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json = argv[++i];
+        else
+            filter = argv[i];
+    }
+
+    Benchmark::runAll(filter);
+
+    if(!json.empty() && !Benchmark::writeJson(json)) {
+        fprintf(stderr, "cannot write %s\n", json.c_str());
+        return 1;
+    }
+
+    return 0;
+}
@@ -6,7 +6,7 @@
 class HealthComponent : public Component<HealthComponent>
 {
 public:
-    HealthComponent(size_t id = 0, float h = 0.0f) : Component(id), health(h) {}
+    HealthComponent(EntityId id = 0, float h = 0.0f) : Component(id), health(h) {}
     float health;
 };
 
@@ -9,8 +9,10 @@ class LightComponent : public Component<LightComponent>
 {
 public:
     LightComponent(EntityId id = 0) : Component(id) {}
-    float intensity;
+    float intensity = 0.0f;
     glm::vec4 direction;
+
+    ECS_COLUMNS(LightComponent, intensity, direction)
 };
 
 #endif // LIGHTCOMPONENT_H
@@ -12,7 +12,9 @@ public:
     PhysicsComponent(EntityId id = 0) : Component(id) {}
     glm::vec3 velocity;
     glm::vec3 position;
-    float mass;
+    float mass = 0.0f;
+
+    ECS_COLUMNS(PhysicsComponent, velocity, position, mass)
 };
 
 #endif // PHYSICSCOMPONENT_H
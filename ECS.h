@@ -5,10 +5,59 @@
 // Basic component class
 #include <cstddef>
 #include <cctype>
+#include <cassert>
+#include <bitset>
 #include <typeinfo>
+#include <cstdint>
 
 typedef unsigned int ComponentType;
-typedef size_t EntityId;
+
+// entity handle, the low bits index the entity and the high bits count how many times
+// the index was recycled, so that a stale handle does not alias the new entity.
+// The top bit is reserved for the pending ids of the command buffers
+typedef uint32_t EntityId;
+
+// number of index bits of a handle, override at compile time if needed
+#ifndef ECS_ENTITY_INDEX_BITS
+#define ECS_ENTITY_INDEX_BITS 24
+#endif
+
+#define ECS_ENTITY_INDEX_MASK ((EntityId(1) << ECS_ENTITY_INDEX_BITS) - 1)
+#define ECS_ENTITY_GENERATION_MASK ((EntityId(1) << (31 - ECS_ENTITY_INDEX_BITS)) - 1)
+
+inline EntityId entityIndex(EntityId id) { return id & ECS_ENTITY_INDEX_MASK; }
+
+inline EntityId entityGeneration(EntityId id) { return (id >> ECS_ENTITY_INDEX_BITS) & ECS_ENTITY_GENERATION_MASK; }
+
+inline EntityId makeEntity(EntityId index, EntityId generation)
+{
+    return ((generation & ECS_ENTITY_GENERATION_MASK) << ECS_ENTITY_INDEX_BITS) | index;
+}
+
+// maximum number of component types, override at compile time if needed
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
+
+#define ECS_CACHE_LINE 64
+
+// set of component types, bit i is set if component type i is present
+typedef std::bitset<ECS_MAX_COMPONENTS> Signature;
+
+// call f(ComponentType) for every component type in the signature
+template<class F> static inline void forEachComponent(const Signature &signature, F f)
+{
+    for(ComponentType type = 0; type < ECS_MAX_COMPONENTS; ++type) {
+        if(signature.test(type))
+            f(type);
+    }
+}
+
+// true if the signature contains all the components of the query
+static inline bool matchesSignature(const Signature &signature, const Signature &query)
+{
+    return (signature & query) == query;
+}
 
 static inline const char* demangle(const char* str)
 {
@@ -27,6 +76,7 @@ public:
     static ComponentType getNextType()
     {
         static ComponentType nextComponentType = 0;
+        assert(nextComponentType < ECS_MAX_COMPONENTS && "increase ECS_MAX_COMPONENTS");
         return nextComponentType++;
     }
 };
@@ -45,6 +95,8 @@ public:
     bool isValid() { return m_id > 0; }
 
 private:
+    friend class CommandBuffers;
+
     const static ComponentType m_type;
     EntityId m_id;
 };
@@ -52,10 +104,249 @@ private:
 template < class T > const ComponentType Component<T>::m_type = ComponentCounter::getNextType();
 
 
+// PROFILER
+// Timed scopes around the passes of the systems and the event dispatch, every thread
+// records its samples in its own ring without locks. The samples are exported as a
+// Chrome trace, opened in chrome://tracing or ui.perfetto.dev, and summarized in
+// percentiles over the samples still in the rings. Disabled by default, a scope then
+// only loads a flag
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// samples kept per thread, the oldest ones are overwritten
+#ifndef ECS_PROFILE_CAPACITY
+#define ECS_PROFILE_CAPACITY (1 << 14)
+#endif
+
+struct ProfileSample {
+    const char *name;
+    const char *category;
+    uint64_t start;
+    uint64_t duration;
+    uint32_t events;
+    uint32_t depth;
+};
+
+// milliseconds
+struct ProfileStats {
+    size_t count;
+    double p50;
+    double p99;
+    double max;
+};
+
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler() : m_enabled(false), m_epoch(Clock::now()) {}
+
+    void enable(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // nanoseconds since the profiler was created
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count();
+    }
+
+    // names and categories are not copied, they must outlive the profiler
+    void record(const ProfileSample &sample)
+    {
+        Ring &ring = local();
+        uint64_t count = ring.count.load(std::memory_order_relaxed);
+        ring.samples[count % ECS_PROFILE_CAPACITY] = sample;
+        ring.count.store(count + 1, std::memory_order_release);
+    }
+
+    // percentiles of the durations of the samples in the rings
+    ProfileStats stats(const char *name, const char *category)
+    {
+        std::vector<uint64_t> durations;
+        forEachSample([&](size_t, const ProfileSample &sample) {
+            if(strcmp(sample.name, name) == 0 && strcmp(sample.category, category) == 0)
+                durations.push_back(sample.duration);
+        });
+
+        ProfileStats stats = {durations.size(), 0.0, 0.0, 0.0};
+        if(durations.empty())
+            return stats;
+
+        stats.p50 = percentile(durations, 50) / 1e6;
+        stats.p99 = percentile(durations, 99) / 1e6;
+        stats.max = *std::max_element(durations.begin(), durations.end()) / 1e6;
+
+        return stats;
+    }
+
+    // one line of stats per name and category
+    void report(FILE *file)
+    {
+        std::vector<std::pair<const char*, const char*>> scopes;
+        forEachSample([&](size_t, const ProfileSample &sample) {
+            auto same = [&](const std::pair<const char*, const char*> &scope) {
+                return strcmp(scope.first, sample.name) == 0 && strcmp(scope.second, sample.category) == 0;
+            };
+            if(std::find_if(scopes.begin(), scopes.end(), same) == scopes.end())
+                scopes.push_back(std::make_pair(sample.name, sample.category));
+        });
+
+        for(const std::pair<const char*, const char*> &scope : scopes) {
+            ProfileStats s = stats(scope.first, scope.second);
+            fprintf(file, "%-24s %-16s %8zu samples  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms\n",
+                    scope.first, scope.second, s.count, s.p50, s.p99, s.max);
+        }
+    }
+
+    // Chrome trace event format, one complete event per sample
+    bool writeTrace(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if(!file)
+            return false;
+
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+        bool first = true;
+        forEachSample([&](size_t thread, const ProfileSample &sample) {
+            fprintf(file, "%s\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %zu, "
+                          "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"events\": %u, \"depth\": %u}}",
+                    first ? "" : ",", sample.name, sample.category, thread,
+                    sample.start / 1e3, sample.duration / 1e3, sample.events, sample.depth);
+            first = false;
+        });
+
+        fprintf(file, "\n]}\n");
+
+        return fclose(file) == 0;
+    }
+
+    // the rings of exited threads are kept, a thread keeps its ring
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(std::unique_ptr<Ring> &ring : m_rings)
+            ring->count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Ring {
+        Ring() : count(0), samples(ECS_PROFILE_CAPACITY) {}
+        std::atomic<uint64_t> count;
+        std::vector<ProfileSample> samples;
+    };
+
+    std::atomic<bool> m_enabled;
+    Clock::time_point m_epoch;
+    std::mutex m_lock;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+
+    // the ring of the calling thread, registered at its first sample
+    Ring &local()
+    {
+        static thread_local Ring *ring = nullptr;
+        if(!ring) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_rings.emplace_back(new Ring());
+            ring = m_rings.back().get();
+        }
+
+        return *ring;
+    }
+
+    // call f(thread, sample) on the samples of every ring, the samples overwritten while
+    // they are read are skipped
+    template<class F> void forEachSample(F f)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for(size_t thread = 0; thread < m_rings.size(); ++thread) {
+            Ring &ring = *m_rings[thread];
+            uint64_t count = ring.count.load(std::memory_order_acquire);
+            uint64_t first = count > ECS_PROFILE_CAPACITY ? count - ECS_PROFILE_CAPACITY : 0;
+
+            for(uint64_t i = first; i < count; ++i) {
+                ProfileSample sample = ring.samples[i % ECS_PROFILE_CAPACITY];
+                if(ring.count.load(std::memory_order_acquire) - i > ECS_PROFILE_CAPACITY)
+                    continue;
+
+                f(thread, sample);
+            }
+        }
+    }
+
+    static uint64_t percentile(std::vector<uint64_t> &values, int percent)
+    {
+        size_t n = (values.size() - 1) * percent / 100;
+        std::nth_element(values.begin(), values.begin() + n, values.end());
+        return values[n];
+    }
+};
+
+// never destroyed, the scopes of the event thread run until the other statics are destroyed
+inline Profiler &profiler()
+{
+    static Profiler *profiler = new Profiler();
+    return *profiler;
+}
+
+// records the time between its construction and destruction if the profiler is enabled
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name, const char *category) : m_active(profiler().enabled())
+    {
+        if(m_active) {
+            m_sample.name = name;
+            m_sample.category = category;
+            m_sample.events = 0;
+            m_sample.depth = 0;
+            m_sample.start = profiler().now();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if(m_active) {
+            m_sample.duration = profiler().now() - m_sample.start;
+            profiler().record(m_sample);
+        }
+    }
+
+    bool active() { return m_active; }
+
+    // events handled in the scope and events still queued
+    void setEvents(uint32_t events, uint32_t depth)
+    {
+        m_sample.events = events;
+        m_sample.depth = depth;
+    }
+
+    // do not record the scope
+    void cancel() { m_active = false; }
+
+private:
+    bool m_active;
+    ProfileSample m_sample;
+};
+
+
 // EVENT
 // Basic Event classes
 #include <unordered_set>
 #include <queue>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <map>
 #include <mutex>
@@ -65,21 +356,119 @@ template < class T > const ComponentType Component<T>::m_type = ComponentCounter
 
 typedef unsigned int EventType;
 
+// maximum number of event types, override at compile time if needed
+#ifndef ECS_MAX_EVENTS
+#define ECS_MAX_EVENTS 256
+#endif
+
 class EventCounter {
 public:
     static EventType getNextType()
     {
         static EventType nextEventType = 0;
+        assert(nextEventType < ECS_MAX_EVENTS && "increase ECS_MAX_EVENTS");
         return nextEventType++;
     }
 };
 
-class BaseEvent
+// Lock free intrusive multi producer/single consumer queue (Vyukov), pushing is a single
+// atomic exchange and never allocates. The consumer may see the queue as temporarily
+// empty while a producer is between the exchange and the link to its node
+class MPSCQueue
+{
+public:
+    struct Node
+    {
+        Node() = default;
+        Node(const Node&) {}
+        Node &operator =(const Node&) { return *this; }
+
+        std::atomic<Node*> next{nullptr};
+    };
+
+    MPSCQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+
+    // called by any thread
+    void push(Node *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *previous = m_head.exchange(node);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // called by the consumer, nullptr if no node is ready
+    Node *pop()
+    {
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+
+        if(tail == &m_stub) {
+            if(!next)
+                return nullptr;
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if(next) {
+            m_tail = next;
+            return tail;
+        }
+
+        // a producer has not linked its node yet
+        if(tail != m_head.load())
+            return nullptr;
+
+        // tail is the last node, put the stub behind it to pop it
+        push(&m_stub);
+
+        next = tail->next.load(std::memory_order_acquire);
+        if(next) {
+            m_tail = next;
+            return tail;
+        }
+
+        return nullptr;
+    }
+
+    // true if every pushed node has been popped
+    bool empty() { return m_head.load() == &m_stub; }
+
+private:
+    std::atomic<Node*> m_head;
+    Node *m_tail;
+    Node m_stub;
+};
+
+class BaseChannel;
+class EventListener;
+
+// events live in slots pooled by the channel of their type and are queued intrusively
+// by the event thread, the sequence number orders events committed on different channels
+class BaseEvent : public MPSCQueue::Node
 {
 public:
+    BaseEvent() : m_channel(nullptr), m_source(0), m_sequence(0) {}
     virtual ~BaseEvent() = default;
 
+    // the bookkeeping belongs to the slot, not to the payload
+    BaseEvent(const BaseEvent&) : MPSCQueue::Node(), m_channel(nullptr), m_source(0), m_sequence(0) {}
+    BaseEvent &operator =(const BaseEvent&) { return *this; }
+
     virtual EventType getType() = 0;
+
+    BaseChannel *channel() { return m_channel; }
+
+    // commit order of the event
+    uint64_t sequence() { return m_sequence; }
+
+private:
+    BaseChannel *m_channel;
+    unsigned int m_source;
+    uint64_t m_sequence;
+
+    friend class BaseChannel;
+    friend class EventThread;
 };
 
 template <class T> class Event : public BaseEvent
@@ -97,162 +486,692 @@ private:
 
 template < class T > const EventType Event<T>::m_type = EventCounter::getNextType();
 
-typedef std::queue<std::shared_ptr<BaseEvent>> EventQueue;
+typedef std::vector<BaseEvent*> EventQueue;
 
-class EventListener
+// Committed events of one type, kept in a ring until every subscriber has read them
+// past its cursor, then their slots go back to the pool of the channel
+class BaseChannel
 {
 public:
-    EventQueue &events() { return m_events; }
-private:
-    EventQueue m_events;
-};
+    BaseChannel() : m_subscribers(0), m_begin(0), m_end(0), m_ring(16) {}
+    virtual ~BaseChannel() = default;
 
-typedef std::map<EventType, std::map<unsigned int, EventListener*>> Subscriptions;
+    // lock free, publishers check it to skip building events nobody reads
+    bool hasSubscribers() { return m_subscribers.load(std::memory_order_relaxed) > 0; }
 
-class EventThread
-{
-public:
-    EventThread() : m_running(true), m_thread(&EventThread::run, this) {}
-    ~EventThread()
+    // the listener receives the events committed from now on
+    void subscribe(EventListener *listener)
     {
-        m_running = false;
-        cv.notify_one();
-        if(m_thread.joinable())
-            m_thread.join();
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(Cursor &cursor : m_cursors) {
+            if(cursor.listener == listener)
+                return;
+        }
+
+        m_cursors.push_back(Cursor{listener, m_end, m_end});
+        m_subscribers = m_cursors.size();
     }
 
-    void pushEvent(BaseEvent* e)
+    void unsubscribe(EventListener *listener)
     {
-        {
-            std::lock_guard<std::mutex> lck(mtx);
-            m_events.push(e);
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(size_t i = 0; i < m_cursors.size(); ++i) {
+            if(m_cursors[i].listener == listener) {
+                m_cursors.erase(m_cursors.begin() + i);
+                break;
+            }
         }
-        cv.notify_one();
+
+        m_subscribers = m_cursors.size();
+        recycle();
     }
 
-    template<class T>
-    void addSubscription(unsigned int listenerId, EventListener* listener)
+    void clear()
     {
-        EventType type(T::type());
-        m_subscriptions[type].insert(std::pair<unsigned int, EventListener*>(listenerId, listener));
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cursors.clear();
+        m_subscribers = 0;
+        recycle();
     }
 
-    void removeSubscription(EventType type, unsigned int listenerId)
+    // make the event visible to the subscribers, called by the dispatching thread
+    void commit(BaseEvent *event)
     {
-       m_subscriptions[type].erase(listenerId);
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        if(m_cursors.empty()) {
+            release(event);
+            return;
+        }
+
+        if(m_end - m_begin == m_ring.size())
+            grow();
+
+        m_ring[m_end++ & (m_ring.size() - 1)] = event;
     }
 
-    void removeAllSubscriptions(unsigned int listenerId)
+    // append the events committed since the last call, they stay valid until release
+    void receive(EventListener *listener, EventQueue &events)
     {
-        for(auto &pair : m_subscriptions)
-            pair.second.erase(listenerId);
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        Cursor *cursor = find(listener);
+        if(!cursor)
+            return;
+
+        for(uint64_t i = cursor->read; i < m_end; ++i)
+            events.push_back(m_ring[i & (m_ring.size() - 1)]);
+
+        cursor->received = m_end;
     }
 
-    void clear()
+    // the listener is done with the received events
+    void release(EventListener *listener)
     {
-        m_subscriptions.clear();
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        Cursor *cursor = find(listener);
+        if(cursor)
+            cursor->read = cursor->received;
+
+        recycle();
     }
 
-private:
-    bool m_running;
+protected:
+    // give the slot back to the pool, called with the channel locked
+    virtual void release(BaseEvent *event) = 0;
 
-    std::thread m_thread;
-    std::mutex mtx;
-    std::condition_variable cv;
+    void stamp(BaseEvent *event) { event->m_channel = this; }
 
-    Subscriptions m_subscriptions;
-    std::queue<BaseEvent*> m_events;
+    std::mutex m_lock;
 
-    void run()
+private:
+    struct Cursor
     {
+        EventListener *listener;
+        uint64_t read;
+        uint64_t received;
+    };
+
+    std::vector<Cursor> m_cursors;
+    std::atomic<size_t> m_subscribers;
+    uint64_t m_begin;
+    uint64_t m_end;
+    std::vector<BaseEvent*> m_ring;
+
+    Cursor *find(EventListener *listener)
+    {
+        for(Cursor &cursor : m_cursors) {
+            if(cursor.listener == listener)
+                return &cursor;
+        }
 
-        while(m_running) {
-            {
-                std::unique_lock<std::mutex> lk(mtx);
-                cv.wait(lk, [this] { return !m_events.empty() || !m_running; });
-            }
+        return nullptr;
+    }
+
+    // release the events read by every subscriber
+    void recycle()
+    {
+        uint64_t end = m_end;
+        for(Cursor &cursor : m_cursors)
+            end = std::min(end, cursor.read);
 
-            while(!m_events.empty()) {
-                std::lock_guard<std::mutex> lck(mtx);
-                BaseEvent *event = m_events.front();
-                m_events.pop();
+        for(; m_begin < end; ++m_begin)
+            release(m_ring[m_begin & (m_ring.size() - 1)]);
+    }
 
-                EventType type(event->getType());
-                std::shared_ptr<BaseEvent> ptr(event);
+    void grow()
+    {
+        std::vector<BaseEvent*> ring(m_ring.size() * 2);
+        for(uint64_t i = m_begin; i < m_end; ++i)
+            ring[i & (ring.size() - 1)] = m_ring[i & (m_ring.size() - 1)];
 
-                for(auto &pair : m_subscriptions[type])
-                    pair.second->events().push(ptr);
-            }
-        }
+        m_ring.swap(ring);
     }
 };
 
-template <typename T> struct StaticStorage
+// Channel of the events of type T, the slots are allocated once and recycled. A recycled
+// slot is reset with the publish arguments if T defines reset(args...), so that events
+// swapping a vector with the publisher hand the capacity back, otherwise it is assigned
+// a new T(args...)
+template<class T> class EventChannel final : public BaseChannel
 {
 public:
-    static T& get() { return m_static; }
+    ~EventChannel()
+    {
+        for(T *event : m_slots)
+            delete event;
+    }
 
-private:
-    static T m_static;
-};
+    template<class... Args> T *acquire(Args&&... args)
+    {
+        T *event = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_poolLock);
+            if(!m_free.empty()) {
+                event = m_free.back();
+                m_free.pop_back();
+            }
+        }
 
-template <typename T> T StaticStorage<T>::m_static;
+        if(event) {
+            reset(*event, 0, std::forward<Args>(args)...);
+            return event;
+        }
 
-class EventDispatcher : public StaticStorage<EventThread> {};
+        event = new T(std::forward<Args>(args)...);
+        stamp(event);
 
-class EventProducer
-{
-public:
-    template<class T>
-    static void publishEvent(T* event)
+        std::lock_guard<std::mutex> lock(m_poolLock);
+        m_slots.push_back(event);
+
+        return event;
+    }
+
+    // slots ever allocated
+    size_t capacity()
     {
-       EventDispatcher::get().pushEvent(event);
+        std::lock_guard<std::mutex> lock(m_poolLock);
+        return m_slots.size();
     }
-};
 
-// SYSTEM
-// Basic system classes
-typedef unsigned int SystemType;
+protected:
+    void release(BaseEvent *event) override
+    {
+        std::lock_guard<std::mutex> lock(m_poolLock);
+        m_free.push_back(static_cast<T*>(event));
+    }
 
-class SystemCounter {
-public:
-    static SystemType getNextType()
+private:
+    // the publishers only contend on the pool, not with the dispatching thread
+    std::mutex m_poolLock;
+    std::vector<T*> m_slots;
+    std::vector<T*> m_free;
+
+    template<class U, class... Args>
+    static auto reset(U &event, int, Args&&... args) -> decltype(event.reset(std::forward<Args>(args)...))
     {
-        static SystemType nextSystemType = 0;
-        return nextSystemType++;
+        return event.reset(std::forward<Args>(args)...);
+    }
+
+    template<class U, class... Args> static void reset(U &event, long, Args&&... args)
+    {
+        event = U(std::forward<Args>(args)...);
     }
 };
 
-class BaseSystem : public EventListener, public EventProducer
+// subscribed channels and received events of a listener, see EventThread::receiveEvents
+class EventListener
 {
 public:
-    virtual ~BaseSystem() = default;
+    virtual ~EventListener() = default;
 
-    virtual void update(float dt) = 0;
+    std::vector<BaseChannel*> &channels() { return m_channels; }
 
-    virtual void processEvents() = 0;
+    EventQueue &events() { return m_events; }
+
+private:
+    std::vector<BaseChannel*> m_channels;
+    EventQueue m_events;
 };
 
-template < class T > class System : public BaseSystem
+// spin iterations of the idle event thread before parking on the condition variable
+#ifndef ECS_EVENT_SPIN
+#define ECS_EVENT_SPIN 2048
+#endif
+
+// maximum number of events committed before checking for shutdown
+#define ECS_EVENT_BATCH 256
+
+// events published while an EventSource is alive on the thread are attributed to its id,
+// the scheduler sets the source of every system it runs, 0 stands for no system
+class EventSource
 {
 public:
-    ~System() { EventDispatcher::get().removeAllSubscriptions(type()); }
+    EventSource(unsigned int source) : m_previous(current()) { current() = source; }
+    ~EventSource() { current() = m_previous; }
 
-    static SystemType type() { return T::m_type; }
+    static unsigned int &current()
+    {
+        static thread_local unsigned int source = 0;
+        return source;
+    }
 
-    static const char* name() { return demangle(typeid(T).name()); }
+private:
+    unsigned int m_previous;
+};
 
-    virtual void update(float dt) {}
+// Threaded delivery commits the events on a background thread as soon as they are
+// published, whether a system receives them in this frame or the next depends on timing.
+// Synchronous delivery runs no thread, the events are buffered until flush() commits them
+// ordered by source and then by publish order, so runs are reproducible
+#ifdef ECS_HEADLESS
+#define ECS_DEFAULT_DELIVERY EventThread::Synchronous
+#else
+#define ECS_DEFAULT_DELIVERY EventThread::Threaded
+#endif
+
+class EventThread
+{
+public:
+    enum Delivery { Threaded, Synchronous };
+
+    EventThread() : m_delivery(ECS_DEFAULT_DELIVERY), m_running(false), m_sleeping(false), m_published(0), m_committed(0)
+    {
+        for(std::atomic<BaseChannel*> &channel : m_channels)
+            channel = nullptr;
+
+        if(m_delivery == Threaded)
+            start();
+    }
+
+    ~EventThread()
+    {
+        stop();
+
+        // hand the events published after the last dispatch back to their pools
+        flush();
+
+        for(std::atomic<BaseChannel*> &channel : m_channels)
+            delete channel.load();
+    }
+
+    // switch the delivery mode, call it while no event is published
+    void setDelivery(Delivery delivery)
+    {
+        if(delivery == m_delivery)
+            return;
+
+        if(delivery == Synchronous) {
+            stop();
+        } else {
+            flush();
+            start();
+        }
+
+        m_delivery = delivery;
+    }
+
+    Delivery delivery() { return m_delivery; }
+
+    // events published and not committed yet
+    uint64_t pending()
+    {
+        std::lock_guard<std::mutex> lock(m_commitLock);
+        return m_published.load() - m_committed;
+    }
+
+    // commit the buffered events, called at the sync points of the frame while no
+    // system runs, does nothing with threaded delivery
+    void flush()
+    {
+        if(m_running)
+            return;
+
+        ProfileScope scope("EventThread", "flush");
+
+        m_flush.clear();
+        while(MPSCQueue::Node *node = m_events.pop())
+            m_flush.push_back(static_cast<BaseEvent*>(node));
+
+        scope.setEvents(m_flush.size(), m_flush.size());
+
+        // the publish order of different threads depends on timing, the source does not
+        std::stable_sort(m_flush.begin(), m_flush.end(), [](BaseEvent *a, BaseEvent *b) {
+            return a->m_source != b->m_source ? a->m_source < b->m_source : a->m_sequence < b->m_sequence;
+        });
+
+        std::lock_guard<std::mutex> lock(m_commitLock);
+        for(BaseEvent *event : m_flush)
+            commit(event);
+    }
+
+    // commit every event published so far, waiting for the event thread if it runs
+    void drain()
+    {
+        flush();
+
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock(m_commitLock);
+                if(m_committed == m_published.load())
+                    return;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    template<class T> EventChannel<T> &channel()
+    {
+        EventType type(T::type());
+        assert(type < ECS_MAX_EVENTS && "increase ECS_MAX_EVENTS");
+
+        BaseChannel *channel = m_channels[type].load(std::memory_order_acquire);
+        if(!channel) {
+            std::lock_guard<std::mutex> lock(m_channelLock);
+            channel = m_channels[type].load();
+            if(!channel) {
+                channel = new EventChannel<T>();
+                m_channels[type].store(channel, std::memory_order_release);
+            }
+        }
+
+        return *static_cast<EventChannel<T>*>(channel);
+    }
+
+    // take a pooled slot and queue it, lock free unless the pool is empty
+    template<class T, class... Args> void publish(Args&&... args)
+    {
+        T *event = channel<T>().acquire(std::forward<Args>(args)...);
+        event->m_source = EventSource::current();
+        event->m_sequence = m_published++;
+
+        pushEvent(event);
+    }
+
+    template<class T>
+    void addSubscription(EventListener* listener)
+    {
+        EventChannel<T> &events = channel<T>();
+        events.subscribe(listener);
+
+        std::vector<BaseChannel*> &channels = listener->channels();
+        if(std::find(channels.begin(), channels.end(), &events) == channels.end())
+            channels.push_back(&events);
+    }
+
+    template<class T>
+    void removeSubscription(EventListener* listener)
+    {
+        EventChannel<T> &events = channel<T>();
+        events.unsubscribe(listener);
+
+        std::vector<BaseChannel*> &channels = listener->channels();
+        channels.erase(std::remove(channels.begin(), channels.end(), &events), channels.end());
+    }
+
+    void removeAllSubscriptions(EventListener* listener)
+    {
+        for(BaseChannel *channel : listener->channels())
+            channel->unsubscribe(listener);
+
+        listener->channels().clear();
+    }
+
+    // events of the subscribed channels committed since the last call in commit order,
+    // events published by the same thread are always received in order
+    EventQueue &receiveEvents(EventListener *listener)
+    {
+        EventQueue &events = listener->events();
+        {
+            // a consistent view of the channels, never in the middle of a batch
+            std::lock_guard<std::mutex> lock(m_commitLock);
+            for(BaseChannel *channel : listener->channels())
+                channel->receive(listener, events);
+        }
+
+        if(listener->channels().size() > 1) {
+            std::sort(events.begin(), events.end(), [](BaseEvent *a, BaseEvent *b) {
+                return a->sequence() < b->sequence();
+            });
+        }
+
+        return events;
+    }
+
+    // the received events can be recycled
+    void releaseEvents(EventListener *listener)
+    {
+        for(BaseChannel *channel : listener->channels())
+            channel->release(listener);
+
+        listener->events().clear();
+    }
+
+    void clear()
+    {
+        for(std::atomic<BaseChannel*> &channel : m_channels) {
+            if(channel.load())
+                channel.load()->clear();
+        }
+    }
+
+private:
+    Delivery m_delivery;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_sleeping;
+    std::atomic<uint64_t> m_published;
+    uint64_t m_committed;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    std::atomic<BaseChannel*> m_channels[ECS_MAX_EVENTS];
+    std::mutex m_channelLock;
+    std::mutex m_commitLock;
+    MPSCQueue m_events;
+    EventQueue m_flush;
+
+    std::thread m_thread;
+
+    void start()
+    {
+        m_running = true;
+        m_thread = std::thread(&EventThread::run, this);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            m_running = false;
+        }
+        cv.notify_one();
+        if(m_thread.joinable())
+            m_thread.join();
+    }
+
+    // lock free, wakes the event thread only if it is parked
+    void pushEvent(BaseEvent* e)
+    {
+        m_events.push(e);
+
+        if(m_sleeping.load()) {
+            { std::lock_guard<std::mutex> lck(mtx); }
+            cv.notify_one();
+        }
+    }
+
+    // the sequence becomes the commit order, called with the commit lock held
+    void commit(BaseEvent *event)
+    {
+        event->m_sequence = m_committed++;
+        event->channel()->commit(event);
+    }
+
+    void run()
+    {
+        while(m_running) {
+            if(dispatch())
+                continue;
+
+            // spin for a while, a frame publishes events in bursts
+            for(int i = 0; i < ECS_EVENT_SPIN && m_events.empty() && m_running; ++i) {
+                if(i > ECS_EVENT_SPIN/16)
+                    std::this_thread::yield();
+            }
+
+            if(!m_events.empty())
+                continue;
+
+            // park, the producers see m_sleeping after pushing and wake the thread
+            std::unique_lock<std::mutex> lk(mtx);
+            m_sleeping = true;
+            cv.wait(lk, [this] { return !m_events.empty() || !m_running; });
+            m_sleeping = false;
+        }
+
+        // commit what was published before stopping
+        while(dispatch()) {}
+    }
+
+    // commit a batch of events to their channels, false if none was ready
+    bool dispatch()
+    {
+        ProfileScope scope("EventThread", "dispatch");
+        std::lock_guard<std::mutex> lock(m_commitLock);
+        int count = 0;
+
+        while(count < ECS_EVENT_BATCH) {
+            MPSCQueue::Node *node = m_events.pop();
+            if(!node)
+                break;
+
+            commit(static_cast<BaseEvent*>(node));
+            ++count;
+        }
+
+        // only the batches that committed events
+        if(count == 0)
+            scope.cancel();
+        else
+            scope.setEvents(count, m_published.load() - m_committed);
+
+        return count > 0;
+    }
+};
+
+template <typename T> struct StaticStorage
+{
+public:
+    static T& get() { return m_static; }
+
+private:
+    static T m_static;
+};
+
+template <typename T> T StaticStorage<T>::m_static;
+
+class EventDispatcher : public StaticStorage<EventThread> {};
+
+class EventProducer
+{
+public:
+    // construct the event in a pooled slot of its channel
+    template<class T, class... Args>
+    static void publishEvent(Args&&... args)
+    {
+        EventDispatcher::get().publish<T>(std::forward<Args>(args)...);
+    }
+};
+
+// SYSTEM
+// Basic system classes
+#include <initializer_list>
+#include <tuple>
+
+typedef unsigned int SystemType;
+
+class SystemCounter {
+public:
+    static SystemType getNextType()
+    {
+        static SystemType nextSystemType = 0;
+        return nextSystemType++;
+    }
+};
+
+class BaseSystem : public EventListener, public EventProducer
+{
+public:
+    BaseSystem() : m_exclusive(true) {}
+    virtual ~BaseSystem() = default;
+
+    virtual void update(float dt) = 0;
+
+    virtual void processEvents() = 0;
+
+    virtual const char *getName() = 0;
+
+    // component types accessed by the system, used to run systems concurrently
+    const Signature &reads() { return m_reads; }
+    const Signature &writes() { return m_writes; }
+
+    // systems without declared accesses never run concurrently with other systems
+    bool exclusive() { return m_exclusive; }
+
+protected:
+    Signature m_reads;
+    Signature m_writes;
+    bool m_exclusive;
+};
+
+// access tags, list the component types a system reads or writes
+template<class... Args> struct Read {};
+template<class... Args> struct Write {};
+
+template<class... Access> struct SystemAccess;
+
+template<> struct SystemAccess<>
+{
+    static void add(Signature &, Signature &) {}
+};
+
+template<class... Args, class... Access> struct SystemAccess<Read<Args...>, Access...>
+{
+    static void add(Signature &reads, Signature &writes)
+    {
+        std::initializer_list<int>{ (reads.set(Args::type()), 0)... };
+        SystemAccess<Access...>::add(reads, writes);
+    }
+};
+
+template<class... Args, class... Access> struct SystemAccess<Write<Args...>, Access...>
+{
+    static void add(Signature &reads, Signature &writes)
+    {
+        std::initializer_list<int>{ (reads.set(Args::type()), writes.set(Args::type()), 0)... };
+        SystemAccess<Access...>::add(reads, writes);
+    }
+};
+
+// class PhysicsSystem : public System<PhysicsSystem, Read<GraphicComponent>, Write<PhysicsComponent>>
+template < class T, class... Access > class System : public BaseSystem
+{
+public:
+    typedef std::tuple<Access...> AccessList;
+
+    System()
+    {
+        SystemAccess<Access...>::add(m_reads, m_writes);
+        m_exclusive = sizeof...(Access) == 0;
+    }
+
+    ~System() { EventDispatcher::get().removeAllSubscriptions(this); }
+
+    static SystemType type() { return T::m_type; }
+
+    static const char* name() { return demangle(typeid(T).name()); }
+
+    const char *getName() { return name(); }
+
+    virtual void update(float) {}
 
     virtual void handleEvent(BaseEvent*) {}
 
     void processEvents()
     {
-        while(!events().empty()) {
-            BaseEvent *event = events().front().get();
+        ProfileScope scope(name(), "processEvents");
+
+        EventQueue &events = EventDispatcher::get().receiveEvents(this);
+        for(BaseEvent *event : events)
             handleEvent(event);
-            events().pop();
-        }
+
+        if(scope.active())
+            scope.setEvents(events.size(), EventDispatcher::get().pending());
+
+        EventDispatcher::get().releaseEvents(this);
     }
 
     template<class... Args> void subscribeTo() { subscribeToEvent<Args...>(); }
@@ -261,11 +1180,11 @@ private:
     const static SystemType m_type;
 
     template<class C>
-    void subscribeToEvent() { EventDispatcher::get().addSubscription<C>(type(), this); }
+    void subscribeToEvent() { EventDispatcher::get().addSubscription<C>(this); }
 
 #if 0
 template<class C, class ... Args> // >=1 template parameters -- ambiguity!
-void subscribeToEvent() { EventDispatcher::addSubscription<C>(type(), this); }
+void subscribeToEvent() { EventDispatcher::addSubscription<C>(this); }
 #endif
 
     template<class T1, class T2, class ...Args>
@@ -276,212 +1195,1555 @@ void subscribeToEvent() { EventDispatcher::addSubscription<C>(type(), this); }
     }
 };
 
-template <class T> const SystemType System<T>::m_type = SystemCounter::getNextType();
+template <class T, class... Access> const SystemType System<T, Access...>::m_type = SystemCounter::getNextType();
 
 
 // CORE EVENTS
-// Events produced in the Container class
-template<class T> class ItemCreated : public Event<ItemCreated<T>>
+// Events produced in the Container class, the components created or deleted since the
+// last flush are published as one batch per type, and only if the batch has subscribers
+template<class E, class T> class ItemBatch : public Event<E>
+{
+public:
+    ItemBatch(std::vector<EntityId> &_ids, std::vector<T> &_items) { reset(_ids, _items); }
+
+    void reset(std::vector<EntityId> &_ids, std::vector<T> &_items)
+    {
+        _ids.swap(ids);
+        _items.swap(items);
+    }
+
+    // ids[i] owns items[i]
+    std::vector<EntityId> ids;
+    std::vector<T> items;
+};
+
+template<class T> class ItemsCreated : public ItemBatch<ItemsCreated<T>, T>
 {
 public:
-    ItemCreated(const T& _item) : item(_item) {}
-    T item;
+    using ItemBatch<ItemsCreated<T>, T>::ItemBatch;
 };
 
-template<class T> class ItemDeleted : public Event<ItemDeleted<T>>
+template<class T> class ItemsDeleted : public ItemBatch<ItemsDeleted<T>, T>
 {
 public:
-    ItemDeleted(const T& _item) : item(_item) {}
-    T item;
+    using ItemBatch<ItemsDeleted<T>, T>::ItemBatch;
 };
 
 
-// CONTAINER
-// Flexible container wrapping std::vector
+// COLUMN STORAGE
+// Storage policies of the containers, components are stored packed in a single vector by
+// default, components declaring their fields with ECS_COLUMNS are split in one cache line
+// aligned vector per field so that systems only pull the fields they touch into cache
+#include <cstdint>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-class BaseContainer
+#define ECS_EXPAND(x) x
+#define ECS_COMMA() ,
+#define ECS_NOTHING()
+
+// apply m(Class, field) to every field, separated by s()
+#define ECS_FOR_EACH_1(m, s, Class, x) m(Class, x)
+#define ECS_FOR_EACH_2(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_1(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_3(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_2(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_4(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_3(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_5(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_4(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_6(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_5(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_7(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_6(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_8(m, s, Class, x, ...) m(Class, x) s() ECS_EXPAND(ECS_FOR_EACH_7(m, s, Class, __VA_ARGS__))
+#define ECS_FOR_EACH_N(_1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define ECS_FOR_EACH(m, s, Class, ...) ECS_EXPAND(ECS_FOR_EACH_N(__VA_ARGS__, \
+    ECS_FOR_EACH_8, ECS_FOR_EACH_7, ECS_FOR_EACH_6, ECS_FOR_EACH_5, \
+    ECS_FOR_EACH_4, ECS_FOR_EACH_3, ECS_FOR_EACH_2, ECS_FOR_EACH_1)(m, s, Class, __VA_ARGS__))
+
+#define ECS_COLUMN_REFERENCE(Class, field) decltype(Class::field) &field;
+#define ECS_COLUMN_FIELD(Class, field) &Class::field
+
+// store the listed fields (up to 8) of a trivially copyable component in separate columns,
+// the container hands out Class::Ref, a struct of references to the fields of one entity
+//
+// class PhysicsComponent : public Component<PhysicsComponent>
+// {
+//     ...
+//     ECS_COLUMNS(PhysicsComponent, velocity, position, mass)
+// };
+#define ECS_COLUMNS(Class, ...) \
+public: \
+    struct Ref { ECS_FOR_EACH(ECS_COLUMN_REFERENCE, ECS_NOTHING, Class, __VA_ARGS__) }; \
+    static auto columnFields() { return std::make_tuple(ECS_FOR_EACH(ECS_COLUMN_FIELD, ECS_COMMA, Class, __VA_ARGS__)); }
+
+// allocator returning memory aligned to Align bytes
+template<class T, size_t Align = ECS_CACHE_LINE> class AlignedAllocator
 {
 public:
-    BaseContainer() = default;
-    virtual ~BaseContainer() = default;
+    typedef T value_type;
 
-    virtual size_t size() = 0;
+    template<class U> struct rebind { typedef AlignedAllocator<U, Align> other; };
 
-    virtual void clear() = 0;
+    AlignedAllocator() = default;
+    template<class U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T *allocate(size_t n)
+    {
+        // keep the unaligned address right before the returned block
+        void *raw = ::operator new(n * sizeof(T) + sizeof(void*) + Align - 1);
+        uintptr_t address = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + Align - 1) & ~uintptr_t(Align - 1);
+        reinterpret_cast<void**>(address)[-1] = raw;
+
+        return reinterpret_cast<T*>(address);
+    }
+
+    void deallocate(T *p, size_t) { ::operator delete(reinterpret_cast<void**>(p)[-1]); }
 
-    virtual void removeItem(size_t id) = 0;
+    template<class U> bool operator ==(const AlignedAllocator<U, Align>&) const { return true; }
+    template<class U> bool operator !=(const AlignedAllocator<U, Align>&) const { return false; }
 };
 
-template<class T>
-class Container : public BaseContainer, public EventProducer
+template<class T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// components stored in a single vector
+template<class T> class PackedStorage
 {
 public:
-    Container() { clear(); }
-    ~Container() { clear(); }
+    typedef T& reference;
+    typedef T* pointer;
+    typedef const T* const_pointer;
 
     size_t size() { return m_items.size(); }
 
-    T& operator [](size_t i) const { return m_items[i]; }
+    reference operator [](size_t i) { return m_items[i]; }
+
+    pointer address(size_t i) { return &m_items[i]; }
+
+    T get(size_t i, EntityId) { return m_items[i]; }
+
+    void set(size_t i, const T &item) { m_items[i] = item; }
+
+    void push_back(const T &item) { m_items.push_back(item); }
+
+    // move the last item to index i, the last slot must be popped afterwards
+    void moveLast(size_t i) { m_items[i] = std::move(m_items.back()); }
+
+    void pop_back() { m_items.pop_back(); }
+
+    void reserve(size_t n) { m_items.reserve(n); }
+
+    void clear() { m_items.clear(); }
+
+    // call g(vector) on the vector of the items
+    template<class G> void forEachArray(G g) { g(m_items); }
+
+    std::vector<T>& items() { return m_items; }
+
+private:
+    std::vector<T> m_items;
+};
+
+template<class T> class ColumnStorage;
+
+// pointer-like handler to the fields of a component stored in columns,
+// like a reference into a vector it is invalidated by insertions and removals
+template<class T> class ColumnPointer
+{
+public:
+    ColumnPointer(std::nullptr_t = nullptr) : m_storage(nullptr), m_index(0) {}
+    ColumnPointer(ColumnStorage<T> *storage, size_t index) : m_storage(storage), m_index(index) {}
+
+    typename T::Ref operator *() const { return (*m_storage)[m_index]; }
+
+    struct Arrow
+    {
+        typename T::Ref ref;
+        typename T::Ref *operator ->() { return &ref; }
+    };
+
+    Arrow operator ->() const { return Arrow{**this}; }
+
+    explicit operator bool() const { return m_storage != nullptr; }
+
+    bool operator ==(std::nullptr_t) const { return m_storage == nullptr; }
+    bool operator !=(std::nullptr_t) const { return m_storage != nullptr; }
+
+private:
+    ColumnStorage<T> *m_storage;
+    size_t m_index;
+};
+
+// components split in one aligned vector per field declared with ECS_COLUMNS
+template<class T> class ColumnStorage
+{
+    typedef decltype(T::columnFields()) Fields;
+
+    template<class M> struct ColumnOf;
+    template<class F> struct ColumnOf<F T::*> { typedef AlignedVector<F> type; };
+
+    template<class Tuple> struct ColumnsOf;
+    template<class... M> struct ColumnsOf<std::tuple<M...>> { typedef std::tuple<typename ColumnOf<M>::type...> type; };
+
+    typedef typename ColumnsOf<Fields>::type Columns;
+    typedef std::make_index_sequence<std::tuple_size<Fields>::value> Indices;
+
+public:
+    typedef typename T::Ref reference;
+    typedef ColumnPointer<T> pointer;
+    typedef ColumnPointer<T> const_pointer;
+
+    size_t size() { return std::get<0>(m_columns).size(); }
+
+    reference operator [](size_t i) { return makeReference(i, Indices()); }
+
+    pointer address(size_t i) { return pointer(this, i); }
+
+    // copy the fields of the item at index i in a new component
+    T get(size_t i, EntityId id)
+    {
+        T item(id);
+        forEachColumn([&](auto &column, auto field) { item.*field = column[i]; });
+        return item;
+    }
+
+    void set(size_t i, const T &item) { forEachColumn([&](auto &column, auto field) { column[i] = item.*field; }); }
+
+    void push_back(const T &item) { forEachColumn([&](auto &column, auto field) { column.push_back(item.*field); }); }
+
+    void moveLast(size_t i) { forEachColumn([i](auto &column, auto) { column[i] = std::move(column.back()); }); }
+
+    void pop_back() { forEachColumn([](auto &column, auto) { column.pop_back(); }); }
+
+    void reserve(size_t n) { forEachColumn([n](auto &column, auto) { column.reserve(n); }); }
+
+    void clear() { forEachColumn([](auto &column, auto) { column.clear(); }); }
+
+    // call g(vector) on every column, in the declaration order of the fields
+    template<class G> void forEachArray(G g) { forEachColumn([&g](auto &column, auto) { g(column); }); }
+
+    // contiguous values of a field, e.g. column(&PhysicsComponent::position)
+    template<class F> F *column(F T::*member) { return column(member, Indices()); }
+
+private:
+    Columns m_columns;
+
+    template<size_t... I> reference makeReference(size_t i, std::index_sequence<I...>)
+    {
+        return reference{ std::get<I>(m_columns)[i]... };
+    }
+
+    template<class G> void forEachColumn(G g) { forEachColumn(g, Indices()); }
+
+    template<class G, size_t... I> void forEachColumn(G &g, std::index_sequence<I...>)
+    {
+        Fields fields = T::columnFields();
+        std::initializer_list<int>{ (g(std::get<I>(m_columns), std::get<I>(fields)), 0)... };
+    }
+
+    template<class F, size_t... I> F *column(F T::*member, std::index_sequence<I...>)
+    {
+        Fields fields = T::columnFields();
+        F *data = nullptr;
+        std::initializer_list<int>{ (data = data ? data : match<I>(member, std::get<I>(fields)), 0)... };
+
+        return data;
+    }
+
+    template<size_t I, class F> F *match(F T::*member, F T::*field)
+    {
+        return member == field ? std::get<I>(m_columns).data() : nullptr;
+    }
+
+    template<size_t I, class F, class G> F *match(F T::*, G T::*) { return nullptr; }
+};
+
+template<class...> struct VoidType { typedef void type; };
+
+// storage policy of a component type, columns if it declares ECS_COLUMNS
+template<class T, class = void> struct ComponentTraits
+{
+    static const bool columns = false;
+    typedef PackedStorage<T> Storage;
+};
+
+template<class T> struct ComponentTraits<T, typename VoidType<typename T::Ref>::type>
+{
+    static const bool columns = true;
+    typedef ColumnStorage<T> Storage;
+};
+
+
+// SPARSE INDEX
+// Map from entity index to a 32-bit dense index, stored in fixed size pages allocated on
+// the first write. Reads never allocate, a missing page reads as npos, and neighbouring
+// entities share a page so walking them in order reads memory linearly
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// entity indices per page, as a power of two, override at compile time if needed
+#ifndef ECS_SPARSE_PAGE_BITS
+#define ECS_SPARSE_PAGE_BITS 12
+#endif
+
+class SparseIndex
+{
+public:
+    static const uint32_t npos = static_cast<uint32_t>(-1);
+
+    uint32_t operator [](EntityId index) const
+    {
+        size_t page = index >> ECS_SPARSE_PAGE_BITS;
+        if(page >= m_pages.size() || !m_pages[page])
+            return npos;
+
+        return m_pages[page][index & pageMask];
+    }
+
+    // slot of the index, allocating its page
+    uint32_t &at(EntityId index)
+    {
+        size_t page = index >> ECS_SPARSE_PAGE_BITS;
+        if(page >= m_pages.size())
+            m_pages.resize(page + 1);
+
+        if(!m_pages[page]) {
+            m_pages[page].reset(new uint32_t[pageSize]);
+            memset(m_pages[page].get(), 0xff, pageSize * sizeof(uint32_t));
+        }
+
+        return m_pages[page][index & pageMask];
+    }
+
+    void clear() { m_pages.clear(); }
+
+    // call f(page, data) on every allocated page
+    template<class F> void forEachPage(F f) const
+    {
+        for(size_t page = 0; page < m_pages.size(); ++page) {
+            if(m_pages[page])
+                f(page, static_cast<const uint32_t*>(m_pages[page].get()));
+        }
+    }
+
+    // entries of the page, allocating it, to fill whole pages at once
+    uint32_t *page(size_t page) { return &at(EntityId(page << ECS_SPARSE_PAGE_BITS)); }
+
+    // bytes held by the pages and the page table
+    size_t memory() const
+    {
+        size_t pages = 0;
+        for(const std::unique_ptr<uint32_t[]> &page : m_pages)
+            pages += page ? 1 : 0;
+
+        return pages * pageSize * sizeof(uint32_t) + m_pages.capacity() * sizeof(m_pages[0]);
+    }
+
+private:
+    static const size_t pageSize = size_t(1) << ECS_SPARSE_PAGE_BITS;
+    static const size_t pageMask = pageSize - 1;
+
+    std::vector<std::unique_ptr<uint32_t[]>> m_pages;
+};
+
+
+// CHANGE TRACKING
+// Every item of a container keeps the tick it was last changed and the tick it was added.
+// The world tick moves forward on every read of the changes and at the end of the frame,
+// so a reader keeping the next tick to read from sees every change exactly once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// maximum number of changes collected before logging them
+#ifndef ECS_CHANGE_BATCH
+#define ECS_CHANGE_BATCH 256
+#endif
+
+class ChangeTicks
+{
+public:
+    ChangeTicks() : m_tick(0), m_frames{0, 0} {}
+
+    // tick stamped on the changes made now
+    uint32_t current() { return m_tick.load(std::memory_order_relaxed); }
+
+    // close the current tick, the changes stamped up to the returned tick can be read
+    uint32_t advance() { return m_tick.fetch_add(1); }
+
+    // advance and return the first tick of the previous frame, older changes are dropped
+    uint32_t endFrame()
+    {
+        m_frames[0] = m_frames[1];
+        m_frames[1] = advance() + 1;
+        return m_frames[0];
+    }
+
+private:
+    std::atomic<uint32_t> m_tick;
+    uint32_t m_frames[2];
+};
+
+class StaticChangeTicks : public StaticStorage<ChangeTicks> {};
+
+// entities changed by tick, appended in tick order since writers of a component type
+// never run concurrently with its readers. Nothing is logged until the first read
+class ChangeLog
+{
+public:
+    ChangeLog() : m_tracked(false) {}
+
+    bool tracked() { return m_tracked.load(std::memory_order_relaxed); }
+
+    void track() { m_tracked = true; }
+
+    void append(const EntityId *ids, size_t count, uint32_t tick)
+    {
+        if(!tracked() || count == 0)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(size_t i = 0; i < count; ++i)
+            m_entries.push_back(Entry(tick, ids[i]));
+    }
+
+    // call f(EntityId, tick) for the entries stamped in [since, until]
+    template<class F> void read(uint32_t since, uint32_t until, F f)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), Entry(since, 0));
+        for(; it != m_entries.end() && it->first <= until; ++it)
+            f(it->second, it->first);
+    }
+
+    // drop the entries older than tick
+    void trim(uint32_t tick)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        auto it = std::lower_bound(m_entries.begin(), m_entries.end(), Entry(tick, 0));
+        m_entries.erase(m_entries.begin(), it);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_entries.clear();
+    }
+
+private:
+    typedef std::pair<uint32_t, EntityId> Entry;
+
+    std::vector<Entry> m_entries;
+    std::atomic<bool> m_tracked;
+    std::mutex m_lock;
+};
+
+
+// CONTAINER
+// Sparse set container, items are packed in a dense storage and indexed by entity id
+#include <vector>
+
+class BaseContainer
+{
+public:
+    BaseContainer() = default;
+    virtual ~BaseContainer() = default;
+
+    virtual size_t size() = 0;
+
+    virtual void clear() = 0;
+
+    virtual bool contains(EntityId id) = 0;
+
+    virtual void removeItem(EntityId id) = 0;
+
+    // publish the lifecycle batches collected since the last call
+    virtual void publishEvents() = 0;
+
+    // drop the logged changes older than tick
+    virtual void trimChanges(uint32_t tick) = 0;
+};
+
+template<class T>
+class Container final : public BaseContainer, public EventProducer
+{
+public:
+    typedef typename ComponentTraits<T>::Storage Storage;
+    typedef typename Storage::reference reference;
+    typedef typename Storage::pointer pointer;
+    typedef typename Storage::const_pointer const_pointer;
+
+    Container() :
+        m_created(EventDispatcher::get().channel<ItemsCreated<T>>()),
+        m_deleted(EventDispatcher::get().channel<ItemsDeleted<T>>())
+    {
+        clear();
+    }
+
+    ~Container() { clear(); }
+
+    size_t size() { return m_items.size(); }
+
+    // access by dense index
+    reference operator [](size_t i) { return m_items[i]; }
+
+    // access by entity id, the entity must own an item
+    reference item(EntityId id) { return m_items[m_indices[entityIndex(id)]]; }
+
+    pointer address(EntityId id) { return m_items.address(m_indices[entityIndex(id)]); }
+
+    // false for stale handles, the dense array keeps the handle of the owner
+    bool contains(EntityId id)
+    {
+        uint32_t index = m_indices[entityIndex(id)];
+        return index != SparseIndex::npos && m_entities[index] == id;
+    }
+
+    // bytes of the entity to item index
+    size_t indexMemory() { return m_indices.memory(); }
+
+    // packed components only
+    std::vector<T>& items() { return m_items.items(); }
+
+    Storage& storage() { return m_items; }
+
+    std::vector<EntityId>& entities() { return m_entities; }
+
+    // entity to item index, for bulk copies with the dense arrays
+    SparseIndex& indices() { return m_indices; }
+
+    // ticks of the item at dense index i, see ChangeTicks
+    uint32_t changedTick(size_t i) { return m_changedTicks[i]; }
+    uint32_t addedTick(size_t i) { return m_addedTicks[i]; }
+
+    // stamp the item of the entity, true if it is the first change of the item in the tick,
+    // the caller logs it with logChanges()
+    bool setChanged(EntityId id, uint32_t tick)
+    {
+        uint32_t &changed = m_changedTicks[m_indices[entityIndex(id)]];
+        if(changed == tick)
+            return false;
+
+        changed = tick;
+        return true;
+    }
+
+    void logChanges(const EntityId *ids, size_t count, uint32_t tick) { m_changeLog.append(ids, count, tick); }
+
+    // stamp the items in the dense range [begin, end), for writes bypassing views
+    void setChanged(size_t begin, size_t end, uint32_t tick)
+    {
+        EntityId ids[ECS_CHANGE_BATCH];
+        size_t count = 0;
+
+        for(size_t i = begin; i < end; ++i) {
+            if(m_changedTicks[i] == tick)
+                continue;
+
+            m_changedTicks[i] = tick;
+            ids[count++] = m_entities[i];
+            if(count == ECS_CHANGE_BATCH) {
+                m_changeLog.append(ids, count, tick);
+                count = 0;
+            }
+        }
+
+        m_changeLog.append(ids, count, tick);
+    }
+
+    // append the entities changed or added in the ticks [since, until], each once
+    void changed(uint32_t since, uint32_t until, std::vector<EntityId> &ids) { read(m_changeLog, m_changedTicks, since, until, ids); }
+    void added(uint32_t since, uint32_t until, std::vector<EntityId> &ids) { read(m_addedLog, m_addedTicks, since, until, ids); }
+
+    void trimChanges(uint32_t tick) override
+    {
+        m_changeLog.trim(tick);
+        m_addedLog.trim(tick);
+    }
+
+    // stamp every item as added and changed in the tick, after the storage, the entities
+    // and the index were filled in bulk
+    void stampItems(uint32_t tick)
+    {
+        m_changedTicks.assign(m_entities.size(), tick);
+        m_addedTicks.assign(m_entities.size(), tick);
+        m_changeLog.append(m_entities.data(), m_entities.size(), tick);
+        m_addedLog.append(m_entities.data(), m_entities.size(), tick);
+    }
+
+    // the container does not know the generations, the callers pass valid handles only,
+    // see ECS::isValid. Removing a stale handle is a no-op since contains() fails
+    reference addItem(EntityId id, const T &item)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        uint32_t &itemIndex = m_indices.at(entityIndex(id));
+        uint32_t tick = StaticChangeTicks::get().current();
+
+        if(itemIndex == SparseIndex::npos) {
+            itemIndex = m_items.size();
+            m_items.push_back(item);
+            m_entities.push_back(id);
+            m_changedTicks.push_back(tick);
+            m_addedTicks.push_back(tick);
+            m_addedLog.append(&id, 1, tick);
+        } else {
+            m_items.set(itemIndex, item);
+            m_entities[itemIndex] = id;
+            m_changedTicks[itemIndex] = tick;
+        }
+
+        m_changeLog.append(&id, 1, tick);
+
+        if(m_created.hasSubscribers()) {
+            m_createdIds.push_back(id);
+            m_createdItems.push_back(item);
+        }
+
+        return m_items[itemIndex];
+    }
+
+    // add or replace the items of the entities, init(T&) is called on every new item,
+    // the storage grows once
+    template<class F> void addItems(const std::vector<EntityId> &ids, F init)
+    {
+        if(ids.empty())
+            return;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        m_items.reserve(m_items.size() + ids.size());
+        m_entities.reserve(m_entities.size() + ids.size());
+        m_changedTicks.reserve(m_changedTicks.size() + ids.size());
+        m_addedTicks.reserve(m_addedTicks.size() + ids.size());
+
+        uint32_t tick = StaticChangeTicks::get().current();
+        m_changeLog.append(ids.data(), ids.size(), tick);
+        m_addedLog.append(ids.data(), ids.size(), tick);
+
+        bool notify = m_created.hasSubscribers();
+        if(notify) {
+            m_createdIds.insert(m_createdIds.end(), ids.begin(), ids.end());
+            m_createdItems.reserve(m_createdItems.size() + ids.size());
+        }
+
+        for(EntityId id : ids) {
+            T item(id);
+            init(item);
+
+            uint32_t &itemIndex = m_indices.at(entityIndex(id));
+            if(itemIndex == SparseIndex::npos) {
+                itemIndex = m_items.size();
+                m_items.push_back(item);
+                m_entities.push_back(id);
+                m_changedTicks.push_back(tick);
+                m_addedTicks.push_back(tick);
+            } else {
+                m_items.set(itemIndex, item);
+                m_entities[itemIndex] = id;
+                m_changedTicks[itemIndex] = tick;
+            }
+
+            if(notify)
+                m_createdItems.push_back(item);
+        }
+    }
+
+    void removeItem(EntityId id) override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        if(!contains(id))
+            return;
+
+        // swap the last item in the hole and pop the back
+        uint32_t index = m_indices[entityIndex(id)];
+        size_t last = m_items.size() - 1;
+
+        if(m_deleted.hasSubscribers()) {
+            m_deletedIds.push_back(id);
+            m_deletedItems.push_back(m_items.get(index, id));
+        }
+
+        if(index != last) {
+            m_items.moveLast(index);
+            m_entities[index] = m_entities[last];
+            m_changedTicks[index] = m_changedTicks[last];
+            m_addedTicks[index] = m_addedTicks[last];
+            m_indices.at(entityIndex(m_entities[index])) = index;
+        }
+
+        m_items.pop_back();
+        m_entities.pop_back();
+        m_changedTicks.pop_back();
+        m_addedTicks.pop_back();
+        m_indices.at(entityIndex(id)) = SparseIndex::npos;
+    }
+
+    void publishEvents() override
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        // the vectors are swapped with the ones of a recycled event
+        if(!m_createdIds.empty()) {
+            publishEvent<ItemsCreated<T>>(m_createdIds, m_createdItems);
+            m_createdIds.clear();
+            m_createdItems.clear();
+        }
+
+        if(!m_deletedIds.empty()) {
+            publishEvent<ItemsDeleted<T>>(m_deletedIds, m_deletedItems);
+            m_deletedIds.clear();
+            m_deletedItems.clear();
+        }
+    }
+
+    void clear()
+    {
+        m_items.clear();
+        m_entities.clear();
+        m_indices.clear();
+        m_changedTicks.clear();
+        m_addedTicks.clear();
+        m_changeLog.clear();
+        m_addedLog.clear();
+        m_createdIds.clear();
+        m_createdItems.clear();
+        m_deletedIds.clear();
+        m_deletedItems.clear();
+    }
+
+private:
+    Storage m_items;
+    std::vector<EntityId> m_entities;
+    SparseIndex m_indices;
+    std::mutex m_lock;
+
+    // change tracking, the ticks are parallel to the items
+    std::vector<uint32_t> m_changedTicks;
+    std::vector<uint32_t> m_addedTicks;
+    ChangeLog m_changeLog;
+    ChangeLog m_addedLog;
+
+    // the items are scanned once when the log starts tracking, then only the log is read,
+    // keeping the entries of living items whose tick is still the logged one
+    void read(ChangeLog &log, std::vector<uint32_t> &ticks, uint32_t since, uint32_t until, std::vector<EntityId> &ids)
+    {
+        size_t first = ids.size();
+
+        if(!log.tracked()) {
+            log.track();
+            for(size_t i = 0; i < ticks.size(); ++i) {
+                if(ticks[i] >= since && ticks[i] <= until)
+                    ids.push_back(m_entities[i]);
+            }
+        } else {
+            log.read(since, until, [&](EntityId id, uint32_t tick) {
+                if(contains(id) && ticks[m_indices[entityIndex(id)]] == tick)
+                    ids.push_back(id);
+            });
+        }
+
+        // an item logged twice in a tick is reported once
+        std::sort(ids.begin() + first, ids.end());
+        ids.erase(std::unique(ids.begin() + first, ids.end()), ids.end());
+    }
+
+    // lifecycle batches of the current frame
+    BaseChannel &m_created;
+    BaseChannel &m_deleted;
+    std::vector<EntityId> m_createdIds;
+    std::vector<T> m_createdItems;
+    std::vector<EntityId> m_deletedIds;
+    std::vector<T> m_deletedItems;
+};
+
+
+// ENTITY POOL
+// Store the signature of every entity, recycling the ids of deleted entities
+
+class EntityPool
+{
+public:
+    EntityPool() { clear(); }
+
+    // number of entity indices, including the free ones
+    size_t size() { return m_signatures.size(); }
+
+    Signature& operator [](EntityId id) { return m_signatures[entityIndex(id)]; }
+
+    std::vector<Signature>& items() { return m_signatures; }
+
+    // handle of the entity currently living at the index
+    EntityId handle(EntityId index) { return makeEntity(index, m_generations[index]); }
+
+    // false for the invalid entity and for deleted ones, their generation was bumped
+    bool isValid(EntityId id)
+    {
+        EntityId index = entityIndex(id);
+        return index > 0 && index < m_generations.size() && m_generations[index] == entityGeneration(id);
+    }
+
+    EntityId addItem()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        EntityId index = m_freeIndex.front();
+
+        if(index == m_signatures.size())
+            grow(index + 1);
+
+        m_freeIndex.pop();
+        if(m_freeIndex.empty())
+            m_freeIndex.push(m_signatures.size());
+
+        return handle(index);
+    }
+
+    // append count ids, recycled ones first, the new ids are contiguous
+    void addItems(size_t count, std::vector<EntityId> &ids)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        ids.reserve(ids.size() + count);
+
+        // the queue holds the recycled indices and the next new index
+        while(count > 0 && !m_freeIndex.empty()) {
+            EntityId index = m_freeIndex.front();
+            m_freeIndex.pop();
+
+            if(index != m_signatures.size()) {
+                ids.push_back(handle(index));
+                --count;
+            }
+        }
+
+        EntityId first = m_signatures.size();
+        grow(first + count);
+        for(size_t i = 0; i < count; ++i)
+            ids.push_back(handle(first + i));
+
+        if(m_freeIndex.empty())
+            m_freeIndex.push(m_signatures.size());
+    }
+
+    std::vector<EntityId>& generations() { return m_generations; }
+
+    // recycled indices followed by the next new index, in the order they are reused
+    std::vector<EntityId> freeIndices()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        std::vector<EntityId> indices;
+        for(std::queue<EntityId> queue(m_freeIndex); !queue.empty(); queue.pop())
+            indices.push_back(queue.front());
+
+        return indices;
+    }
+
+    // replace the pool with count entity indices and their free list
+    void assign(const Signature *signatures, const EntityId *generations, size_t count,
+                const EntityId *free, size_t freeCount)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        m_signatures.assign(signatures, signatures + count);
+        m_generations.assign(generations, generations + count);
+        m_freeIndex = std::queue<EntityId>(std::deque<EntityId>(free, free + freeCount));
+    }
+
+    void removeItem(EntityId id)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        EntityId index = entityIndex(id);
+        m_signatures[index].reset();
+        m_generations[index] = (m_generations[index] + 1) & ECS_ENTITY_GENERATION_MASK;
+        m_freeIndex.push(index);
+    }
+
+    void clear()
+    {
+        // index 0 is reserved for invalid entities
+        m_signatures.clear();
+        m_generations.clear();
+        grow(1);
+
+        std::queue<EntityId> empty;
+        std::swap(m_freeIndex, empty);
+        m_freeIndex.push(1);
+    }
+
+private:
+    std::vector<Signature> m_signatures;
+    std::vector<EntityId> m_generations;
+    std::queue<EntityId> m_freeIndex;
+    std::mutex m_lock;
+
+    void grow(size_t size)
+    {
+        assert(size - 1 <= ECS_ENTITY_INDEX_MASK);
+
+        m_signatures.resize(size);
+        m_generations.resize(size, 0);
+    }
+};
+
+
+// ENTITY SET
+// Packed set of entity handles with constant time insertion and removal, indexed by entity index
+class EntitySet
+{
+public:
+    typedef std::vector<EntityId>::iterator iterator;
+    typedef std::vector<EntityId>::const_iterator const_iterator;
+
+    size_t size() const { return m_items.size(); }
+
+    bool empty() const { return m_items.empty(); }
+
+    bool contains(EntityId id) const
+    {
+        uint32_t index = m_indices[entityIndex(id)];
+        return index != SparseIndex::npos && m_items[index] == id;
+    }
+
+    void insert(EntityId id)
+    {
+        uint32_t &index = m_indices.at(entityIndex(id));
+        if(index != SparseIndex::npos)
+            return;
+
+        index = m_items.size();
+        m_items.push_back(id);
+    }
+
+    // insert sorted ids in a single pass
+    void insert(const std::vector<EntityId> &ids)
+    {
+        if(ids.empty())
+            return;
+
+        m_items.reserve(m_items.size() + ids.size());
+
+        for(EntityId id : ids) {
+            uint32_t &index = m_indices.at(entityIndex(id));
+            if(index == SparseIndex::npos) {
+                index = m_items.size();
+                m_items.push_back(id);
+            }
+        }
+    }
+
+    void erase(EntityId id)
+    {
+        if(!contains(id))
+            return;
+
+        uint32_t index = m_indices[entityIndex(id)];
+        m_items[index] = m_items.back();
+        m_indices.at(entityIndex(m_items[index])) = index;
+
+        m_items.pop_back();
+        m_indices.at(entityIndex(id)) = SparseIndex::npos;
+    }
+
+    void clear()
+    {
+        m_items.clear();
+        m_indices.clear();
+    }
+
+    iterator begin() { return m_items.begin(); }
+    iterator end() { return m_items.end(); }
+    const_iterator begin() const { return m_items.begin(); }
+    const_iterator end() const { return m_items.end(); }
+
+private:
+    std::vector<EntityId> m_items;
+    SparseIndex m_indices;
+};
+
+
+// QUERY CACHE
+// Entities matching the signatures requested by the systems, registered on first
+// use and updated with a bitmask test on every structural change
+#include <unordered_map>
+
+class Query
+{
+public:
+    Query(const Signature &signature) : m_signature(signature) {}
+
+    const Signature &signature() { return m_signature; }
+
+    EntitySet &entities() { return m_entities; }
+
+    void update(EntityId id, const Signature &before, const Signature &after)
+    {
+        bool matched = matchesSignature(before, m_signature);
+        bool matches = matchesSignature(after, m_signature);
+
+        if(matches && !matched)
+            m_entities.insert(id);
+        else if(matched && !matches)
+            m_entities.erase(id);
+    }
+
+private:
+    Signature m_signature;
+    EntitySet m_entities;
+};
+
+class QueryCache
+{
+public:
+    // register the query on first use, filling it with the matching entities
+    EntitySet &entitiesMatchingSignature(const Signature &signature, EntityPool &entities)
+    {
+        auto it = m_queries.find(signature);
+        if(it != m_queries.end())
+            return it->second.entities();
+
+        Query &query = m_queries.insert(std::make_pair(signature, Query(signature))).first->second;
+        m_list.push_back(&query);
+        fill(query, entities);
+
+        return query.entities();
+    }
+
+    // refill the registered queries after the entities were replaced in bulk, the sets
+    // handed out stay valid
+    void rebuild(EntityPool &entities)
+    {
+        for(Query *query : m_list) {
+            query->entities().clear();
+            fill(*query, entities);
+        }
+    }
+
+    // the entity signature changed from before to after
+    void update(EntityId id, const Signature &before, const Signature &after)
+    {
+        for(Query *query : m_list)
+            query->update(id, before, after);
+    }
+
+    // a component of the type was added to the sorted entities, their signatures
+    // already include it, only the queries involving the type can change
+    void insert(const std::vector<EntityId> &ids, ComponentType type, EntityPool &entities)
+    {
+        for(Query *query : m_list) {
+            if(!query->signature().test(type))
+                continue;
+
+            m_matching.clear();
+            for(EntityId id : ids) {
+                if(matchesSignature(entities[id], query->signature()))
+                    m_matching.push_back(id);
+            }
+
+            query->entities().insert(m_matching);
+        }
+    }
+
+    void clear()
+    {
+        m_list.clear();
+        m_queries.clear();
+    }
+
+private:
+    std::unordered_map<Signature, Query> m_queries;
+    std::vector<Query*> m_list;
+    std::vector<EntityId> m_matching;
+
+    // scan the signatures, the matching entities are inserted in id order at once
+    void fill(Query &query, EntityPool &entities)
+    {
+        m_matching.clear();
+        for(EntityId index = 1; index < entities.size(); ++index) {
+            if(matchesSignature(entities.items()[index], query.signature()))
+                m_matching.push_back(entities.handle(index));
+        }
+
+        query.entities().insert(m_matching);
+    }
+};
+
+
+// THREAD POOL
+// Work stealing pool, every worker owns a task deque and steals from the others when idle
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// minimum number of items processed by a parallel task
+#ifndef ECS_PARALLEL_GRAIN
+#define ECS_PARALLEL_GRAIN 1024
+#endif
+
+static constexpr size_t greatestCommonDivisor(size_t a, size_t b) { return b == 0 ? a : greatestCommonDivisor(b, a % b); }
+
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    // the calling thread helps while waiting, so one worker less than the hardware threads
+    ThreadPool(size_t threads = std::max(std::thread::hardware_concurrency(), 1u) - 1) : m_running(true), m_pending(0)
+    {
+        // queue 0 is shared by the threads outside the pool
+        for(size_t i = 0; i <= threads; ++i)
+            m_queues.emplace_back(new TaskQueue());
+
+        for(size_t i = 1; i <= threads; ++i)
+            m_threads.emplace_back(&ThreadPool::run, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_running = false;
+        }
+        m_wake.notify_all();
+
+        for(std::thread &thread : m_threads)
+            thread.join();
+    }
+
+    // number of worker threads
+    size_t size() { return m_threads.size(); }
+
+    // index of the calling worker, 0 for threads outside the pool
+    size_t workerIndex() { return currentPool() == this ? currentIndex() : 0; }
+
+    void submit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_pending++;
+        }
+
+        TaskQueue &queue = *m_queues[workerIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        m_wake.notify_one();
+    }
+
+    // run one pending task, from the own queue first and then stealing, return false if none
+    bool runPendingTask()
+    {
+        Task task;
+        if(!popTask(workerIndex(), task))
+            return false;
+
+        task();
+        return true;
+    }
+
+private:
+    struct TaskQueue {
+        std::deque<Task> tasks;
+        std::mutex lock;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_sleepLock;
+    std::condition_variable m_wake;
+    bool m_running;
+    size_t m_pending;
+
+    static ThreadPool *&currentPool()
+    {
+        static thread_local ThreadPool *pool = nullptr;
+        return pool;
+    }
+
+    static size_t &currentIndex()
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    bool popTask(size_t index, Task &task)
+    {
+        // own tasks are taken from the back, stolen ones from the front
+        for(size_t i = 0; i < m_queues.size(); ++i) {
+            TaskQueue &queue = *m_queues[(index + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.lock);
+
+            if(queue.tasks.empty())
+                continue;
+
+            if(i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            std::lock_guard<std::mutex> sleepLock(m_sleepLock);
+            m_pending--;
+            return true;
+        }
+
+        return false;
+    }
+
+    void run(size_t index)
+    {
+        currentPool() = this;
+        currentIndex() = index;
+
+        while(true) {
+            Task task;
+            if(popTask(index, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepLock);
+            m_wake.wait(lock, [this] { return m_pending > 0 || !m_running; });
+
+            if(!m_running)
+                return;
+        }
+    }
+};
+
+// Set of tasks run on a pool, the waiting thread runs pending tasks until all of them are done
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool &pool) : m_pool(pool), m_count(0) {}
+    ~TaskGroup() { wait(); }
+
+    void run(ThreadPool::Task task)
+    {
+        m_count++;
+        m_pool.submit([this, task] {
+            task();
+            m_count--;
+        });
+    }
+
+    void wait()
+    {
+        while(m_count > 0) {
+            if(!m_pool.runPendingTask())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    ThreadPool &m_pool;
+    std::atomic<size_t> m_count;
+};
+
+// number of consecutive T filling a whole number of cache lines
+template<class T> constexpr size_t cacheLineElements()
+{
+    return ECS_CACHE_LINE / greatestCommonDivisor(sizeof(T) % ECS_CACHE_LINE, ECS_CACHE_LINE);
+}
+
+// split [0, count) in ranges whose length is a multiple of align
+// and call f(begin, end) concurrently on the pool
+template<class F> void parallelFor(ThreadPool &pool, size_t count, size_t align, F f)
+{
+    size_t threads = pool.size() + 1;
+    size_t chunk = std::max(static_cast<size_t>(ECS_PARALLEL_GRAIN), count / (threads * 4));
+    chunk = (chunk + align - 1) / align * align;
+
+    if(threads == 1 || count <= chunk) {
+        f(static_cast<size_t>(0), count);
+        return;
+    }
+
+    TaskGroup group(pool);
+    for(size_t begin = 0; begin < count; begin += chunk) {
+        size_t end = std::min(begin + chunk, count);
+        group.run([&f, begin, end] { f(begin, end); });
+    }
+    group.wait();
+}
+
+// One cache line padded value per pool thread, used to reduce without locks
+template<class T> class PerThread
+{
+public:
+    PerThread(ThreadPool &pool, const T &value = T()) : m_pool(pool), m_slots(pool.size() + 1, Slot(value)) {}
+
+    // value of the calling thread
+    T &local() { return m_slots[m_pool.workerIndex()].value; }
+
+    size_t size() { return m_slots.size(); }
+
+    T &operator [](size_t i) { return m_slots[i].value; }
+
+    // call f(T&) on the value of every thread
+    template<class F> void forEach(F f)
+    {
+        for(Slot &slot : m_slots)
+            f(slot.value);
+    }
+
+private:
+    struct Slot {
+        Slot(const T &_value) : value(_value), padding() {}
+        T value;
+        char padding[ECS_CACHE_LINE];
+    };
+
+    ThreadPool &m_pool;
+    std::vector<Slot> m_slots;
+};
 
-    T& operator [](size_t i) { return m_items[i]; }
 
-    T& item(size_t index) { return m_items[index]; }
+// FRAME ARENA
+// Linear allocators for the transient data of a frame, allocating bumps an atomic offset
+// and nothing is freed until the reset. Two arenas alternate so that the data allocated
+// in a frame, like the payloads of the events published in it, stays valid while it is
+// received in the next one. The destructors of the objects are not run before the reset,
+// so the payloads of recycled events must be trivially destructible
+#include <atomic>
+#include <memory>
+#include <mutex>
 
-    std::vector<T>& items() { return m_items; }
+// initial capacity of the arenas, they grow to the peak use of a frame
+#ifndef ECS_ARENA_CAPACITY
+#define ECS_ARENA_CAPACITY (1 << 20)
+#endif
 
-    size_t freeIndex() { return m_freeIndex.front(); }
+class LinearArena
+{
+public:
+    LinearArena(size_t capacity = ECS_ARENA_CAPACITY) : m_offset(0) { m_block.resize(capacity); }
 
-    size_t addItem(const T &item)
+    void *allocate(size_t size, size_t align)
     {
+        size_t offset = m_offset.fetch_add(size + align - 1, std::memory_order_relaxed);
+        if(offset + size + align - 1 <= m_block.size())
+            return alignUp(m_block.data() + offset, align);
+
+        // full, served from the heap until the reset grows the block
         std::lock_guard<std::mutex> lock(m_lock);
+        m_overflow.emplace_back(new char[size + align - 1]);
+        return alignUp(m_overflow.back().get(), align);
+    }
 
-        size_t itemIndex = m_freeIndex.front();
+    // bytes requested since the reset, may exceed the capacity
+    size_t used() { return m_offset.load(std::memory_order_relaxed); }
 
-        if(itemIndex == m_items.size())
-            m_items.push_back(item);
-        else
-            m_items[itemIndex] = item;
+    size_t capacity() { return m_block.size(); }
 
-        m_freeIndex.pop();
-        if(m_freeIndex.empty())
-            m_freeIndex.push(m_items.size());
+    // must not run concurrently with allocate()
+    void reset()
+    {
+        size_t used = m_offset.load(std::memory_order_relaxed);
 
-        publishEvent(new ItemCreated<T>(item));
+        if(used > m_block.size()) {
+            size_t capacity = m_block.size() ? m_block.size() : 1;
+            while(capacity < used)
+                capacity *= 2;
+
+            m_overflow.clear();
+            AlignedVector<char> block(capacity);
+            m_block.swap(block);
+        }
 
-        return itemIndex;
+        m_offset.store(0, std::memory_order_relaxed);
     }
 
-    void removeItem(size_t index) override
+private:
+    AlignedVector<char> m_block;
+    std::atomic<size_t> m_offset;
+    std::vector<std::unique_ptr<char[]>> m_overflow;
+    std::mutex m_lock;
+
+    static void *alignUp(char *p, size_t align)
     {
-        std::lock_guard<std::mutex> lock(m_lock);
+        return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~uintptr_t(align - 1));
+    }
+};
 
-        T item = m_items[index];
+class FrameArena
+{
+public:
+    FrameArena() : m_frame(0) {}
 
-        if(index == m_items.size() - 1)
-            m_items.pop_back();
-        else
-            m_items[index] = T();
+    // arena of the current frame
+    LinearArena &current() { return m_arenas[m_frame & 1]; }
 
-        m_freeIndex.push(index);
+    // arena of the previous frame, still valid
+    LinearArena &previous() { return m_arenas[(m_frame + 1) & 1]; }
 
-        publishEvent(new ItemDeleted<T>(item));
-    }
+    void *allocate(size_t size, size_t align) { return current().allocate(size, align); }
 
-    void clear()
+    // start a new frame reusing the arena of the frame before the previous one,
+    // called when no system runs and the events of that frame were received
+    void swap()
     {
-        m_items.clear();
-        m_items.push_back(T());
-
-        std::queue<size_t> empty;
-        std::swap( m_freeIndex, empty );
-        m_freeIndex.push(1);
+        ++m_frame;
+        current().reset();
     }
 
 private:
-    std::vector<T> m_items;
-    std::queue<size_t> m_freeIndex;
-    std::mutex m_lock;
+    LinearArena m_arenas[2];
+    size_t m_frame;
 };
 
+class StaticFrameArena : public StaticStorage<FrameArena> {};
+
+// allocator over the frame arena, deallocation is a no-op
+template<class T> class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator() : m_arena(&StaticFrameArena::get()) {}
+    ArenaAllocator(FrameArena &arena) : m_arena(&arena) {}
+    template<class U> ArenaAllocator(const ArenaAllocator<U> &other) : m_arena(other.arena()) {}
+
+    T *allocate(size_t n) { return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T))); }
 
-// SIGNATURE TREE
-// Store entities ID based on their component signature
-#include <boost/container/flat_set.hpp>
-#include <set>
+    void deallocate(T*, size_t) {}
 
-typedef std::set<unsigned int> Signature;
+    FrameArena *arena() const { return m_arena; }
 
-struct SignatureNode{
-    boost::container::flat_set<size_t> items;
-    std::map<unsigned int, SignatureNode> children;
+    template<class U> bool operator ==(const ArenaAllocator<U> &other) const { return m_arena == other.arena(); }
+    template<class U> bool operator !=(const ArenaAllocator<U> &other) const { return m_arena != other.arena(); }
+
+private:
+    FrameArena *m_arena;
 };
 
-class SignatureTree
+// vector for the data of one frame, valid until the end of the next frame
+template<class T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+
+// VIEW
+// Iterate the entities owning all the requested components, driving from the smallest container.
+// The items of mutable component types are stamped as changed, list a type as const to only read it
+#include <type_traits>
+#include <utility>
+
+// stamp the items visited by a view and log them in batches
+template<class T> class ChangeRecorder
 {
 public:
-    void addToSignature(size_t id, Signature signature, unsigned int component)
+    ChangeRecorder(Container<T> *container, uint32_t tick) : m_container(container), m_tick(tick), m_size(0) {}
+    ChangeRecorder(const ChangeRecorder &other) : ChangeRecorder(other.m_container, other.m_tick) {}
+    ~ChangeRecorder() { if(m_size) flush(); }
+
+    void record(EntityId id)
     {
-        for(unsigned int i : signature) {
-            addRecursive(&(root.children[i]), id, component, signature, i);
-            signature.erase(signature.begin());
-        }
+        if(!m_container->setChanged(id, m_tick))
+            return;
+
+        m_ids[m_size++] = id;
+        if(m_size == ECS_CHANGE_BATCH)
+            flush();
     }
 
-    void removeFromSignature(size_t id, Signature signature, unsigned int component)
+private:
+    Container<T> *m_container;
+    uint32_t m_tick;
+    size_t m_size;
+    EntityId m_ids[ECS_CHANGE_BATCH];
+
+    void flush()
     {
-        for(unsigned int i : signature) {
-            removeRecursive(&(root.children[i]), id, component, signature, i);
-            signature.erase(signature.begin());
-        }
+        m_container->logChanges(m_ids, m_size, m_tick);
+        m_size = 0;
     }
+};
+
+template<class T> class ChangeRecorder<const T>
+{
+public:
+    ChangeRecorder(Container<T>*, uint32_t) {}
+
+    void record(EntityId) {}
+};
+
+template<class... Args> class View
+{
+public:
+    View(ThreadPool &pool, uint32_t tick, Container<typename std::remove_const<Args>::type>*... containers) :
+        m_pool(pool), m_tick(tick), m_containers(containers...) {}
 
-    void removeAll(size_t id, Signature signature)
+    // call f(EntityId, Args&...) for every matching entity, components stored in columns
+    // are passed as Args::Ref, components must not be added or removed during the iteration
+    template<class F> void each(F f)
     {
-        for(unsigned int i : signature) {
-            removeAllRecursive(&(root.children[i]), id, signature, i);
-            signature.erase(signature.begin());
-        }
+        std::vector<EntityId> &list = smallest(std::index_sequence_for<Args...>());
+        each(f, list, 0, list.size(), std::index_sequence_for<Args...>());
     }
 
-    boost::container::flat_set<size_t>& itemsMatchingSignature(const Signature &signature)
+    // same as each, but f is called concurrently on cache line aligned chunks of entities
+    template<class F> void parallelEach(F f)
     {
-        SignatureNode *node = &root;
-
-        for(unsigned int type : signature)
-            node = &(node->children[type]);
+        std::vector<EntityId> &list = smallest(std::index_sequence_for<Args...>());
 
-        return node->items;
+        parallelFor(m_pool, list.size(), cacheLineElements<EntityId>(), [&](size_t begin, size_t end) {
+            each(f, list, begin, end, std::index_sequence_for<Args...>());
+        });
     }
 
 private:
-    SignatureNode root;
+    ThreadPool &m_pool;
+    uint32_t m_tick;
+    std::tuple<Container<typename std::remove_const<Args>::type>*...> m_containers;
 
-    void addRecursive(SignatureNode *node, size_t id, unsigned int component, Signature signature, unsigned int nodeId)
+    template<size_t... I> std::vector<EntityId> &smallest(std::index_sequence<I...>)
     {
-        if(nodeId >= component)
-            node->items.insert(id);
+        std::vector<EntityId> *lists[] = { &(std::get<I>(m_containers)->entities())... };
 
-        signature.erase(signature.begin());
-
-        for(unsigned int type : signature) {
-            addRecursive(&(node->children[type]), id, component, signature, type);
-            signature.erase(signature.begin());
+        std::vector<EntityId> *smallest = lists[0];
+        for(std::vector<EntityId> *list : lists) {
+            if(list->size() < smallest->size())
+                smallest = list;
         }
+
+        return *smallest;
     }
 
-    void removeRecursive(SignatureNode *node, size_t id, unsigned int component, Signature signature, unsigned int nodeId)
+    template<class F, size_t... I>
+    void each(F &f, std::vector<EntityId> &list, size_t begin, size_t end, std::index_sequence<I...>)
     {
-        if(nodeId >= component)
-            node->items.erase(id);
+        std::tuple<ChangeRecorder<Args>...> recorders(ChangeRecorder<Args>(std::get<I>(m_containers), m_tick)...);
 
-        signature.erase(signature.begin());
-
-        for(unsigned int type : signature) {
-            removeRecursive(&(node->children[type]), id, component, signature, type);
-            signature.erase(signature.begin());
+        for(size_t i = begin; i < end; ++i) {
+            EntityId id = list[i];
+            if(containsAll(id, std::get<I>(m_containers)...)) {
+                f(id, std::get<I>(m_containers)->item(id)...);
+                std::initializer_list<int>{ (std::get<I>(recorders).record(id), 0)... };
+            }
         }
     }
 
-    void removeAllRecursive(SignatureNode *node, size_t id, Signature signature, unsigned int nodeId)
-    {
-        node->items.erase(id);
-
-        signature.erase(signature.begin());
+    static bool containsAll(EntityId) { return true; }
 
-        for(unsigned int type : signature) {
-            removeAllRecursive(&(node->children[type]), id, signature, type);
-            signature.erase(signature.begin());
-        }
+    template<class C, class... Cs> static bool containsAll(EntityId id, C *container, Cs*... containers)
+    {
+        return container->contains(id) && containsAll(id, containers...);
     }
 };
 
 
 // STORAGE
 // Static storage classes, wrappers for containers
-typedef size_t ComponentIndex;
-
-typedef std::vector<ComponentIndex> ComponentList;
 typedef std::vector<BaseContainer*> ComponentStorage;
 typedef std::vector<BaseSystem*> SystemStorage;
 
@@ -489,75 +2751,313 @@ typedef std::pair<ComponentType, BaseContainer*> ComponentStorageItem;
 typedef std::pair<SystemType, BaseSystem*> SystemStorageItem;
 
 class StaticComponentStorage : public StaticStorage<ComponentStorage> {};
-class StaticEntityStorage : public StaticStorage<Container<ComponentList>> {};
-class StaticSignatureTree : public StaticStorage<SignatureTree> {};
+class StaticEntityStorage : public StaticStorage<EntityPool> {};
+class StaticQueryCache : public StaticStorage<QueryCache> {};
 class StaticSystemStorage : public StaticStorage<SystemStorage> {};
 
 
+// SCHEDULER
+// Build the dependency graph of the systems from their component accesses and
+// run the ones not conflicting concurrently, systems keep their creation order
+class Scheduler
+{
+public:
+    Scheduler() : m_parallel(true) {}
+
+    // run the systems one after another in creation order
+    void setParallel(bool parallel) { m_parallel = parallel; }
+
+    bool parallel() { return m_parallel; }
+
+    // call f(BaseSystem*) for every system, the events published by a system are
+    // attributed to its position in creation order
+    template<class F> void run(SystemStorage &systems, ThreadPool &pool, F f)
+    {
+        m_nodes.clear();
+        for(BaseSystem *system : systems) {
+            if(system)
+                m_nodes.push_back(system);
+        }
+
+        if(!m_parallel || pool.size() == 0 || m_nodes.size() < 2) {
+            for(size_t i = 0; i < m_nodes.size(); ++i) {
+                EventSource source(i + 1);
+                f(m_nodes[i]);
+            }
+            return;
+        }
+
+        buildGraph();
+
+        std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[m_nodes.size()]);
+        for(size_t i = 0; i < m_nodes.size(); ++i)
+            remaining[i] = m_dependencies[i];
+
+        TaskGroup group(pool);
+        std::function<void(size_t)> launch = [&](size_t node) {
+            group.run([&, node] {
+                {
+                    EventSource source(node + 1);
+                    f(m_nodes[node]);
+                }
+
+                for(size_t next : m_successors[node]) {
+                    if(--remaining[next] == 0)
+                        launch(next);
+                }
+            });
+        };
+
+        for(size_t i = 0; i < m_nodes.size(); ++i) {
+            if(m_dependencies[i] == 0)
+                launch(i);
+        }
+
+        group.wait();
+    }
+
+private:
+    bool m_parallel;
+    std::vector<BaseSystem*> m_nodes;
+    std::vector<std::vector<size_t>> m_successors;
+    std::vector<size_t> m_dependencies;
+
+    static bool conflict(BaseSystem *a, BaseSystem *b)
+    {
+        if(a->exclusive() || b->exclusive())
+            return true;
+
+        return (a->writes() & b->reads()).any() || (b->writes() & a->reads()).any();
+    }
+
+    // a system depends on every previous system it conflicts with
+    void buildGraph()
+    {
+        m_successors.assign(m_nodes.size(), std::vector<size_t>());
+        m_dependencies.assign(m_nodes.size(), 0);
+
+        for(size_t j = 0; j < m_nodes.size(); ++j) {
+            for(size_t i = 0; i < j; ++i) {
+                if(conflict(m_nodes[i], m_nodes[j])) {
+                    m_successors[i].push_back(j);
+                    m_dependencies[j]++;
+                }
+            }
+        }
+    }
+};
+
+class StaticThreadPool : public StaticStorage<ThreadPool> {};
+class StaticScheduler : public StaticStorage<Scheduler> {};
+
+
 // ECS
 // Main ECS class, manage entity/system/component creation and deletion
-typedef boost::container::flat_set<size_t> EntitySet;
+#include <iterator>
+
+class CommandBuffer;
 
 class ECS {
 public:
-    // create a new component and return a temporary handler
-    template<class T, typename... Targs> static T* createComponent(EntityId id, Targs... args)
+    // create a new component and return a temporary handler, nullptr for deleted entities
+    // and stale handles
+    template<class T, typename... Targs> static typename Container<T>::pointer createComponent(EntityId id, Targs... args)
     {
+        if(!isValid(id))
+            return nullptr;
+
         ComponentType type(T::type());
         T component(id, args...);
 
         Container<T> *container = componentContainer<T>();
-        ComponentIndex index = container->addItem(component);
+        container->addItem(id, component);
+        typename Container<T>::pointer item = container->address(id);
+
+        // update queries
+        Signature &signature = entities()[id];
+        if(!signature.test(type)) {
+            Signature before(signature);
+            signature.set(type);
+            queries().update(id, before, signature);
+        }
+
+        return item;
+    }
+
+    // create a component of type T for every entity, init(T&) is called on each of them.
+    // Deleted entities and stale handles are skipped, like in createComponent
+    template<class T, class F> static void createComponents(const std::vector<EntityId> &ids, F init)
+    {
+        if(!std::all_of(ids.begin(), ids.end(), [](EntityId id) { return isValid(id); })) {
+            std::vector<EntityId> valid;
+            std::copy_if(ids.begin(), ids.end(), std::back_inserter(valid), [](EntityId id) { return isValid(id); });
+            createComponents<T>(valid, init);
+            return;
+        }
+
+        ComponentType type(T::type());
 
-        // update signature tree
-        if(entities()[id].size() <= type)
-            entities()[id].resize(type + 1, 0);
-        entities()[id][type] = index;
+        componentContainer<T>()->addItems(ids, init);
 
-        signatureTree().addToSignature(id, entitySignature(id), type);
+        for(EntityId id : ids)
+            entities()[id].set(type);
 
-        return &(container->item(index));
+        // update queries in id order
+        std::vector<EntityId> sorted(ids);
+        if(!std::is_sorted(sorted.begin(), sorted.end()))
+            std::sort(sorted.begin(), sorted.end());
+
+        queries().insert(sorted, type, entities());
+    }
+
+    template<class T> static void createComponents(const std::vector<EntityId> &ids)
+    {
+        createComponents<T>(ids, [](T&) {});
     }
 
+    // no-op for deleted entities and stale handles
     template<class T> static void deleteComponent(EntityId id)
     {
         ComponentType type(T::type());
         removeComponent(id, type);
     }
 
+    // components stored in columns are accessed through componentContainer<T>()->storage()
     template<class T> static std::vector<T>* components()
     {
         Container<T> *container = componentContainer<T>();
         return &(container->items());
     }
 
-    template<class T> static T* component(EntityId id)
+    // typed iteration over the entities owning all the requested components,
+    // the components of the types not listed as const are marked as changed
+    template<class... Args> static View<Args...> view()
+    {
+        return View<Args...>(threadPool(), changeTicks().current(), componentContainer<typename std::remove_const<Args>::type>()...);
+    }
+
+    // call f(EntityId, T&) concurrently on cache line aligned chunks of the components of type T,
+    // f gets a T::Ref for components stored in columns, every component is marked as changed
+    template<class T, class F> static void parallelEach(F f)
     {
-        ComponentIndex index = componentIndex(id, T::type());
         Container<T> *container = componentContainer<T>();
-        return &(container->item(index));
+        uint32_t tick = changeTicks().current();
+
+        // a multiple of the elements per cache line of every column
+        size_t align = ComponentTraits<T>::columns ? ECS_CACHE_LINE : cacheLineElements<T>();
+
+        parallelFor(threadPool(), container->size(), align, [&](size_t begin, size_t end) {
+            for(size_t i = begin; i < end; ++i)
+                f(container->entities()[i], (*container)[i]);
+
+            container->setChanged(begin, end, tick);
+        });
     }
 
-    static EntityId createEntity() { return entities().addItem(ComponentList()); }
+    // return nullptr if the entity does not own a component of type T or the handle is stale,
+    // the component is marked as changed unless T is const
+    template<class T> static typename std::conditional<std::is_const<T>::value,
+        typename Container<typename std::remove_const<T>::type>::const_pointer,
+        typename Container<typename std::remove_const<T>::type>::pointer>::type component(EntityId id)
+    {
+        typedef typename std::remove_const<T>::type Type;
 
-    static void deleteEntity(EntityId id)
+        Container<Type> *container = componentContainer<Type>();
+        if(!container->contains(id))
+            return nullptr;
+
+        if(!std::is_const<T>::value) {
+            uint32_t tick = changeTicks().current();
+            if(container->setChanged(id, tick))
+                container->logChanges(&id, 1, tick);
+        }
+
+        return container->address(id);
+    }
+
+    // append the entities whose component of type T changed or was added since tick and move
+    // tick past them, a reader keeping its tick sees every change once if it reads every frame
+    template<class T> static void changed(uint32_t &tick, std::vector<EntityId> &ids)
+    {
+        uint32_t until = changeTicks().advance();
+        componentContainer<T>()->changed(tick, until, ids);
+        tick = until + 1;
+    }
+
+    // same as changed, for the components added since tick
+    template<class T> static void added(uint32_t &tick, std::vector<EntityId> &ids)
     {
-        signatureTree().removeAll(id, entitySignature(id));
+        uint32_t until = changeTicks().advance();
+        componentContainer<T>()->added(tick, until, ids);
+        tick = until + 1;
+    }
+
+    // publish the lifecycle batches of the containers and commit the buffered events,
+    // called at the sync points of the frame
+    static void flushEvents()
+    {
+        for(BaseContainer *container : components()) {
+            if(container)
+                container->publishEvents();
+        }
+
+        events().flush();
+    }
+
+    // end of the frame: the published events are committed, the frame arena is swapped
+    // releasing the data allocated in the previous frame, and the change logs are trimmed
+    static void endFrame()
+    {
+        events().drain();
+        frameArena().swap();
 
-        for (const ComponentType &type : entitySignature(id)) {
-            ComponentIndex index = componentIndex(id, type);
-            components()[type]->removeItem(index);
+        uint32_t tick = changeTicks().endFrame();
+        for(BaseContainer *container : components()) {
+            if(container)
+                container->trimChanges(tick);
         }
+    }
+
+    static EntityId createEntity() { return entities().addItem(); }
+
+    // false for deleted entities and stale handles
+    static bool isValid(EntityId id) { return entities().isValid(id); }
+
+    static std::vector<EntityId> createEntities(size_t count)
+    {
+        std::vector<EntityId> ids;
+        entities().addItems(count, ids);
+
+        return ids;
+    }
+
+    // no-op for deleted entities and stale handles
+    static void deleteEntity(EntityId id)
+    {
+        if(!isValid(id))
+            return;
+
+        const Signature &signature = entitySignature(id);
+        queries().update(id, signature, Signature());
+
+        forEachComponent(signature, [id](ComponentType type) {
+            components()[type]->removeItem(id);
+        });
 
         entities().removeItem(id);
     }
 
     template<class... Args> static EntitySet* entitiesWithComponents()
+    {
+        return &(queries().entitiesMatchingSignature(signature<Args...>(), entities()));
+    }
+
+    template<class... Args> static Signature signature()
     {
         Signature signature;
         addToSignature<Args...>(signature);
 
-        return &(signatureTree().itemsMatchingSignature(signature));
+        return signature;
     }
 
     template<class T, typename... Targs> static T* createSystem(Targs... args)
@@ -567,8 +3067,11 @@ public:
         if(systems().size() <= type)
             systems().resize(type + 1, nullptr);
 
-        if(systems()[type] == nullptr)
+        if(systems()[type] == nullptr) {
+            // create the accessed containers before the systems run concurrently
+            registerContainers(typename T::AccessList());
             systems()[type] = new T(args...);
+        }
 
         return static_cast<T*>(systems()[type]);
     }
@@ -597,14 +3100,10 @@ public:
         systems().clear();
         components().clear();
         entities().clear();
+        queries().clear();
     }
 
-    static ComponentStorage &components() { return StaticComponentStorage::get(); }
-    static Container<ComponentList> &entities() { return StaticEntityStorage::get(); }
-    static SignatureTree &signatureTree() { return StaticSignatureTree::get(); }
-    static SystemStorage &systems() { return StaticSystemStorage::get(); }
-
-private:
+    // container of the components of type T, gives access to the columns of the storage
     template<class T> static Container<T> *componentContainer()
     {
         ComponentType type(T::type());
@@ -618,49 +3117,322 @@ private:
         return static_cast<Container<T>*>(components()[type]);
     }
 
-    static ComponentIndex componentIndex(EntityId id, ComponentType type)
-    {
-        ComponentList *list = &entities()[id];
-        if(list->size() <= type)
-            list->resize(type + 1, 0);
+    static ComponentStorage &components() { return StaticComponentStorage::get(); }
+    static EventThread &events() { return EventDispatcher::get(); }
+    static EntityPool &entities() { return StaticEntityStorage::get(); }
+    static QueryCache &queries() { return StaticQueryCache::get(); }
+    static ThreadPool &threadPool() { return StaticThreadPool::get(); }
+    static Profiler &profiler() { return ::profiler(); }
+    static FrameArena &frameArena() { return StaticFrameArena::get(); }
+    static ChangeTicks &changeTicks() { return StaticChangeTicks::get(); }
+    static Scheduler &scheduler() { return StaticScheduler::get(); }
+    static SystemStorage &systems() { return StaticSystemStorage::get(); }
 
-        return (*list)[type];
-    }
+    // command buffer of the calling thread, the structural changes recorded by the systems
+    // are applied by playbackCommands() at the sync points of the frame
+    static CommandBuffer &commands();
+    static void playbackCommands();
+
+private:
+    friend class CommandBuffers;
+
+    static const Signature &entitySignature(EntityId id) { return entities()[id]; }
 
-    static Signature entitySignature(EntityId id)
+    template<class... Access> static void registerContainers(std::tuple<Access...>)
     {
-        Signature signature;
-        for(unsigned int i = 0; i < entities()[id].size(); ++i) {
-            if(entities()[id][i] != 0)
-                signature.insert(i);
-        }
+        std::initializer_list<int>{ (registerAccess(Access()), 0)... };
+    }
 
-        return signature;
+    template<template<class...> class Access, class... Args> static void registerAccess(Access<Args...>)
+    {
+        std::initializer_list<int>{ (componentContainer<Args>(), 0)... };
     }
 
     static void removeComponent(EntityId id, const ComponentType type)
     {
-        // update signature tree
-        signatureTree().removeFromSignature(id, entitySignature(id), type);
-        ComponentIndex index = componentIndex(id, type);
-        components()[type]->removeItem(index);
-        entities()[id][type] = 0;
+        if(!isValid(id))
+            return;
+
+        Signature &signature = entities()[id];
+        if(!signature.test(type))
+            return;
+
+        // update queries
+        Signature before(signature);
+        signature.reset(type);
+        queries().update(id, before, signature);
+        components()[type]->removeItem(id);
     }
 
     template<class T>
-    static void addToSignature(std::set<unsigned int> &signature) { signature.insert(T::type()); }
+    static void addToSignature(Signature &signature) { signature.set(T::type()); }
 
 #if 0
 template<class T, class ... Args> // >=1 template parameters -- ambiguity!
-static void addToSignature(std::set<unsigned int> &signature) { signature.insert(T::type()); }
+static void addToSignature(Signature &signature) { signature.set(T::type()); }
 #endif
 
     template<class T1, class T2, class ...Args>
-    static void addToSignature(std::set<unsigned int> &signature)
+    static void addToSignature(Signature &signature)
     {
         addToSignature<T1>(signature);
         addToSignature<T2, Args...>(signature);
     }
 };
 
+
+// COMMAND BUFFER
+// Structural changes recorded concurrently by the systems, one buffer per pool thread.
+// The playback applies the commands of a frame in phases: entity creations, component
+// creations, component deletions and entity deletions, each one sorted and batched. The
+// commands on deleted entities and stale handles are dropped before batching
+class BaseCommandPayloads
+{
+public:
+    virtual ~BaseCommandPayloads() {}
+    virtual void clear() = 0;
+};
+
+template<class T> class CommandPayloads : public BaseCommandPayloads
+{
+public:
+    void clear() override { items.clear(); }
+
+    std::vector<T> items;
+};
+
+class CommandBuffer
+{
+public:
+    CommandBuffer() {}
+
+    // the slots of PerThread are copies of an empty buffer
+    CommandBuffer(const CommandBuffer&) {}
+
+    // return a pending id, valid only in the commands of this buffer until the playback
+    EntityId createEntity()
+    {
+        m_created.push_back(EventSource::current());
+        return pendingBit | (m_created.size() - 1);
+    }
+
+    void deleteEntity(EntityId id) { m_deleted.push_back(id); }
+
+    // the component is built now and copied into its container at the playback
+    template<class T, typename... Targs> void createComponent(EntityId id, Targs... args)
+    {
+        std::vector<T> &items = payloads<T>();
+        m_added.push_back(Added{id, T::type(), EventSource::current(), m_added.size(),
+                                items.size(), &CommandBuffer::createComponents<T>});
+        items.push_back(T(id, args...));
+    }
+
+    template<class T> void deleteComponent(EntityId id)
+    {
+        m_removed.push_back(std::make_pair(id, T::type()));
+    }
+
+    bool empty() { return m_created.empty() && m_deleted.empty() && m_added.empty() && m_removed.empty(); }
+
+    static bool isPending(EntityId id) { return (id & pendingBit) != 0; }
+
+private:
+    friend class CommandBuffers;
+
+    static const EntityId pendingBit = EntityId(1) << (sizeof(EntityId) * 8 - 1);
+
+    struct Added {
+        EntityId entity;
+        ComponentType type;
+        unsigned int source;
+        size_t order;
+        size_t payload;
+        void (*apply)(std::vector<Added*>::iterator begin, std::vector<Added*>::iterator end);
+        CommandBuffer *buffer;
+    };
+
+    std::vector<unsigned int> m_created;
+    std::vector<EntityId> m_resolved;
+    std::vector<EntityId> m_deleted;
+    std::vector<Added> m_added;
+    std::vector<std::pair<EntityId, ComponentType>> m_removed;
+    std::vector<std::unique_ptr<BaseCommandPayloads>> m_payloads;
+
+    template<class T> std::vector<T> &payloads()
+    {
+        ComponentType type(T::type());
+
+        if(m_payloads.size() <= type)
+            m_payloads.resize(type + 1);
+
+        if(!m_payloads[type])
+            m_payloads[type].reset(new CommandPayloads<T>());
+
+        return static_cast<CommandPayloads<T>*>(m_payloads[type].get())->items;
+    }
+
+    EntityId resolve(EntityId id) { return isPending(id) ? m_resolved[id & ~pendingBit] : id; }
+
+    // create the components of one type in a single batch, the payloads keep the id they
+    // were recorded with so it is replaced with the one of the entity
+    template<class T> static void createComponents(std::vector<Added*>::iterator begin, std::vector<Added*>::iterator end);
+
+    void clear()
+    {
+        m_created.clear();
+        m_resolved.clear();
+        m_deleted.clear();
+        m_added.clear();
+        m_removed.clear();
+
+        for(std::unique_ptr<BaseCommandPayloads> &payloads : m_payloads) {
+            if(payloads)
+                payloads->clear();
+        }
+    }
+};
+
+class CommandBuffers
+{
+public:
+    CommandBuffers(ThreadPool &pool) : m_buffers(pool) {}
+
+    // threads outside the pool share the buffer of slot 0, only the main thread should record there
+    CommandBuffer &local() { return m_buffers.local(); }
+
+    template<class T> static void createComponents(std::vector<CommandBuffer::Added*>::iterator begin,
+                                                   std::vector<CommandBuffer::Added*>::iterator end)
+    {
+        // drop the entities deleted before the playback so that the payloads stay in step with the ids
+        end = std::remove_if(begin, end, [](const CommandBuffer::Added *added) { return !ECS::isValid(added->entity); });
+
+        std::vector<EntityId> ids;
+        ids.reserve(end - begin);
+        for(auto it = begin; it != end; ++it)
+            ids.push_back((*it)->entity);
+
+        auto it = begin;
+        ECS::createComponents<T>(ids, [&it](T &item) {
+            EntityId id = item.id();
+            item = (*it)->buffer->template payloads<T>()[(*it)->payload];
+            static_cast<Component<T>&>(item).m_id = id;
+            ++it;
+        });
+    }
+
+    void playback()
+    {
+        // entities in order of source, so that the ids do not depend on the thread a system ran on
+        m_created.clear();
+        for(size_t slot = 0; slot < m_buffers.size(); ++slot) {
+            CommandBuffer &buffer = m_buffers[slot];
+            for(size_t i = 0; i < buffer.m_created.size(); ++i)
+                m_created.push_back(Created{buffer.m_created[i], slot, i});
+        }
+
+        std::sort(m_created.begin(), m_created.end(), [](const Created &a, const Created &b) {
+            return std::tie(a.source, a.slot, a.index) < std::tie(b.source, b.slot, b.index);
+        });
+
+        std::vector<EntityId> ids = ECS::createEntities(m_created.size());
+        for(size_t i = 0; i < m_created.size(); ++i) {
+            CommandBuffer &buffer = m_buffers[m_created[i].slot];
+            buffer.m_resolved.resize(buffer.m_created.size());
+            buffer.m_resolved[m_created[i].index] = ids[i];
+        }
+
+        // components grouped by type and entity, the last one recorded wins
+        m_added.clear();
+        for(size_t slot = 0; slot < m_buffers.size(); ++slot) {
+            CommandBuffer &buffer = m_buffers[slot];
+            for(CommandBuffer::Added &added : buffer.m_added) {
+                added.entity = buffer.resolve(added.entity);
+                added.buffer = &buffer;
+                m_added.push_back(&added);
+            }
+        }
+
+        std::stable_sort(m_added.begin(), m_added.end(), [](const CommandBuffer::Added *a, const CommandBuffer::Added *b) {
+            return std::tie(a->type, a->entity, a->source, a->order) < std::tie(b->type, b->entity, b->source, b->order);
+        });
+
+        auto last = std::unique(m_added.rbegin(), m_added.rend(), [](const CommandBuffer::Added *a, const CommandBuffer::Added *b) {
+            return a->type == b->type && a->entity == b->entity;
+        });
+        m_added.erase(m_added.begin(), last.base());
+
+        for(auto begin = m_added.begin(); begin != m_added.end(); ) {
+            auto end = std::find_if(begin, m_added.end(), [begin](const CommandBuffer::Added *added) {
+                return added->type != (*begin)->type;
+            });
+
+            (*begin)->apply(begin, end);
+            begin = end;
+        }
+
+        m_removed.clear();
+        for(size_t slot = 0; slot < m_buffers.size(); ++slot) {
+            CommandBuffer &buffer = m_buffers[slot];
+            for(const std::pair<EntityId, ComponentType> &removed : buffer.m_removed) {
+                EntityId id = buffer.resolve(removed.first);
+                if(ECS::isValid(id))
+                    m_removed.push_back(std::make_pair(id, removed.second));
+            }
+        }
+
+        std::sort(m_removed.begin(), m_removed.end(), [](const std::pair<EntityId, ComponentType> &a, const std::pair<EntityId, ComponentType> &b) {
+            return std::tie(a.second, a.first) < std::tie(b.second, b.first);
+        });
+        m_removed.erase(std::unique(m_removed.begin(), m_removed.end()), m_removed.end());
+
+        for(const std::pair<EntityId, ComponentType> &removed : m_removed)
+            ECS::removeComponent(removed.first, removed.second);
+
+        m_deleted.clear();
+        for(size_t slot = 0; slot < m_buffers.size(); ++slot) {
+            CommandBuffer &buffer = m_buffers[slot];
+            for(EntityId id : buffer.m_deleted) {
+                if(ECS::isValid(buffer.resolve(id)))
+                    m_deleted.push_back(buffer.resolve(id));
+            }
+        }
+
+        std::sort(m_deleted.begin(), m_deleted.end());
+        m_deleted.erase(std::unique(m_deleted.begin(), m_deleted.end()), m_deleted.end());
+
+        for(EntityId id : m_deleted)
+            ECS::deleteEntity(id);
+
+        m_buffers.forEach([](CommandBuffer &buffer) { buffer.clear(); });
+    }
+
+private:
+    struct Created {
+        unsigned int source;
+        size_t slot;
+        size_t index;
+    };
+
+    PerThread<CommandBuffer> m_buffers;
+    std::vector<Created> m_created;
+    std::vector<CommandBuffer::Added*> m_added;
+    std::vector<std::pair<EntityId, ComponentType>> m_removed;
+    std::vector<EntityId> m_deleted;
+};
+
+template<class T> void CommandBuffer::createComponents(std::vector<Added*>::iterator begin, std::vector<Added*>::iterator end)
+{
+    CommandBuffers::createComponents<T>(begin, end);
+}
+
+inline CommandBuffers &commandBuffers()
+{
+    static CommandBuffers buffers(ECS::threadPool());
+    return buffers;
+}
+
+inline CommandBuffer &ECS::commands() { return commandBuffers().local(); }
+
+inline void ECS::playbackCommands() { commandBuffers().playback(); }
+
 #endif // ECS_H
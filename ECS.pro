@@ -1,10 +1,20 @@
 TEMPLATE = app
 
-CONFIG += console c++11
+CONFIG += console c++14
 CONFIG -= app_bundle
 CONFIG -= qt
 
-LIBS += -L/usr/local/lib -lSDL2 -lGL -lglut -lGLEW -lpthread
+# keep the simd kernels bit exact with the scalar path
+QMAKE_CXXFLAGS += -ffp-contract=off
+
+LIBS += -lpthread
+
+# qmake CONFIG+=headless builds the simulation without the window and OpenGL
+headless {
+    DEFINES += ECS_HEADLESS
+} else {
+    LIBS += -L/usr/local/lib -lSDL2 -lGL -lglut -lGLEW
+}
 
 SOURCES += \
         main.cpp \
@@ -21,7 +31,11 @@ HEADERS += \
     Systems/PhysicsSystem.h \
     Systems/RenderingSystem.h \
     Events/Collision.h \
-    Events/EntityMoved.h \
     ECS.h \
+    Archetype.h \
+    Simd.h \
     Engine.h \
-    Systems/CollisionSystem.h
+    Runner.h \
+    Snapshot.h \
+    Systems/CollisionSystem.h \
+    Systems/SpatialHash.h
@@ -6,15 +6,22 @@
 
 #include <iostream>
 
-#include "ECS.h"
+#include "Runner.h"
 
 #define MS_PER_UPDATE 17
 
-class Engine
+// window and OpenGL context on top of the runner, polls the window events at the start of
+// every frame and draws after its ticks. The simulation advances MS_PER_UPDATE per tick in
+// real time while frames are drawn as fast as possible, draw() blends the last two states
+// with alpha()
+class Engine : public Runner
 {
 public:
-    Engine() : m_running(false)
+    Engine() : Runner(MS_PER_UPDATE / 1000.0f)
     {
+        setPacing(RealTime);
+        setFrameRate(std::numeric_limits<double>::infinity());
+
         if(SDL_Init(SDL_INIT_VIDEO) != 0) {
             std::cout << "SDL_Init Error: " << SDL_GetError() << std::endl;
             exit(1);
@@ -52,47 +59,28 @@ public:
         // Clean up
         SDL_Quit();
 
-        ECS::cleanUp();
-
         cleanUp();
     }
 
-    int run()
-    {
-        m_running = true;
-
-        while(m_running) {
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            processEvents();
-            updateSystems(1.0f/60.0f);
-            draw();
-
-            // Swap OpenGL buffers
-            SDL_GL_SwapWindow(m_window);
-        }
-        return 0;
-    }
-
     SDL_Window *window() { return m_window; }
     SDL_GLContext &context() { return m_context; }
 
 protected:
     virtual bool init() { return true; }
-    virtual void handleEvent(SDL_Event &event) {}
+    virtual void handleEvent(SDL_Event &) {}
     virtual void draw() {}
     virtual void cleanUp() {}
 
 private:
     SDL_Window *m_window;
     SDL_GLContext m_context;
-    bool m_running;
 
-    void processEvents()
+    void poll() override
     {
         SDL_Event event;
         while(SDL_PollEvent(&event)) {
-            m_running = event.type != SDL_QUIT;
+            if(event.type == SDL_QUIT)
+                stop();
 
             // handle window resize here
             if(event.type == SDL_WINDOWEVENT)
@@ -103,19 +91,14 @@ private:
         }
     }
 
-    void updateSystems(float dt)
+    void present() override
     {
-        for(size_t i = 0; i < ECS::systems().size(); ++i) {
-            if(ECS::systems()[i]) {
-                ECS::systems()[i]->processEvents();
-                ECS::systems()[i]->update(dt);
-            }
-        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        for(size_t i = 0; i < ECS::systems().size(); ++i) {
-            if(ECS::systems()[i])
-                ECS::systems()[i]->processEvents();
-        }
+        draw();
+
+        // Swap OpenGL buffers
+        SDL_GL_SwapWindow(m_window);
     }
 };
 
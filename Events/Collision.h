@@ -8,8 +8,12 @@ typedef std::pair<EntityId, EntityId> CollisionPair;
 class Collision : public Event<Collision>
 {
 public:
-    Collision(std::vector<CollisionPair> &_collisions) { _collisions.swap(collisions); }
-    std::vector<CollisionPair> collisions;
+    Collision(ArenaVector<CollisionPair> &_collisions) : collisions(std::move(_collisions)) {}
+
+    // the pairs live in the frame arena, a recycled event drops its previous ones
+    void reset(ArenaVector<CollisionPair> &_collisions) { collisions = std::move(_collisions); }
+
+    ArenaVector<CollisionPair> collisions;
 };
 
 #endif // COLLISION_H
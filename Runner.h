@@ -0,0 +1,190 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <thread>
+
+#include "ECS.h"
+
+// RUNNER
+// Drives the systems without a window, every tick advances the simulation by a fixed
+// timestep. Ticks run back to back or paced to the wall clock, for a given count or until
+// stop() is called. With real time pacing the elapsed time is accumulated and consumed in
+// whole ticks, frames are presented at their own rate with alpha() the fraction of a tick
+// left in the accumulator, to interpolate the last two states. A frame runs at most
+// maxSteps() ticks, the time it is still behind is dropped instead of spiralling into
+// longer and longer frames. Engine adds the window and the rendering on top of it
+class Runner
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Pacing { Unlimited, RealTime };
+
+    Runner(float timestep = 1.0f/60.0f) :
+        m_timestep(timestep),
+        m_pacing(Unlimited),
+        m_frameInterval(std::numeric_limits<double>::infinity()),
+        m_maxSteps(5),
+        m_running(false),
+        m_ticks(0),
+        m_accumulator(0.0),
+        m_alpha(0.0f),
+        m_frames(0),
+        m_slowFrames(0),
+        m_droppedTicks(0) {}
+
+    virtual ~Runner() { ECS::cleanUp(); }
+
+    // run count ticks, or until stop() is called if count is 0, returns the ticks run
+    uint64_t run(uint64_t count = 0)
+    {
+        m_running = true;
+        m_start = m_previous = Clock::now();
+        m_accumulator = 0.0;
+        m_alpha = 0.0f;
+
+        uint64_t first = m_ticks;
+        while(m_running && (count == 0 || m_ticks - first < count)) {
+            poll();
+
+            if(m_pacing == Unlimited) {
+                step();
+            } else {
+                Clock::time_point now = Clock::now();
+                m_accumulator += std::chrono::duration<double>(now - m_previous).count();
+                m_previous = now;
+
+                int steps = 0;
+                while(m_accumulator >= m_timestep && (count == 0 || m_ticks - first < count)) {
+                    if(steps == m_maxSteps) {
+                        uint64_t behind = static_cast<uint64_t>(m_accumulator / m_timestep);
+                        m_accumulator -= behind * double(m_timestep);
+                        m_droppedTicks += behind;
+                        break;
+                    }
+
+                    step();
+                    m_accumulator -= m_timestep;
+                    steps++;
+                }
+
+                // frames running more than one tick are catching up
+                if(steps > 1)
+                    m_slowFrames++;
+
+                m_alpha = static_cast<float>(std::min(1.0, m_accumulator / m_timestep));
+            }
+
+            present();
+            m_frames++;
+
+            if(m_pacing == RealTime)
+                waitNextFrame();
+        }
+
+        m_running = false;
+        return m_ticks - first;
+    }
+
+    // advance the simulation by one timestep
+    void step()
+    {
+        ProfileScope scope("Runner", "tick");
+        updateSystems(m_timestep);
+        m_ticks++;
+    }
+
+    void stop() { m_running = false; }
+
+    bool running() { return m_running; }
+
+    void setPacing(Pacing pacing) { m_pacing = pacing; }
+    Pacing pacing() { return m_pacing; }
+
+    void setTimestep(float timestep) { m_timestep = timestep; }
+    float timestep() { return m_timestep; }
+
+    // frames presented per second with real time pacing, 0 presents when a tick is due and
+    // infinity as fast as possible
+    void setFrameRate(double fps) { m_frameInterval = 1.0 / fps; }
+
+    // ticks a frame can run to catch up with the wall clock
+    void setMaxSteps(int steps) { m_maxSteps = steps; }
+    int maxSteps() { return m_maxSteps; }
+
+    // fraction of a tick elapsed since the last one, to interpolate the drawn states
+    float alpha() { return m_alpha; }
+
+    uint64_t ticks() { return m_ticks; }
+    uint64_t frames() { return m_frames; }
+
+    // frames that ran more than one tick, and ticks dropped at the catch-up limit
+    uint64_t slowFrames() { return m_slowFrames; }
+    uint64_t droppedTicks() { return m_droppedTicks; }
+
+    // seconds since the last run started
+    double elapsed() { return std::chrono::duration<double>(Clock::now() - m_start).count(); }
+
+protected:
+    // called at the start of every frame and after its ticks
+    virtual void poll() {}
+    virtual void present() {}
+
+private:
+    float m_timestep;
+    Pacing m_pacing;
+    double m_frameInterval;
+    int m_maxSteps;
+    bool m_running;
+    uint64_t m_ticks;
+    Clock::time_point m_start;
+    Clock::time_point m_previous;
+    double m_accumulator;
+    float m_alpha;
+    uint64_t m_frames;
+    uint64_t m_slowFrames;
+    uint64_t m_droppedTicks;
+
+    // sleep until the next tick is due, or until the next frame if frames are presented faster
+    void waitNextFrame()
+    {
+        double wait = std::min(m_timestep - m_accumulator, m_frameInterval);
+        if(wait > 0.0)
+            std::this_thread::sleep_until(m_previous + std::chrono::duration_cast<Clock::duration>(
+                                              std::chrono::duration<double>(wait)));
+    }
+
+    // lifecycle batches are published at the flushes, with synchronous delivery all the
+    // events are committed there too: the events published by the updates are received
+    // in the second pass, the ones published while handling events in the next frame
+    void updateSystems(float dt)
+    {
+        ECS::flushEvents();
+
+        // systems with non conflicting component accesses run concurrently
+        ECS::scheduler().run(ECS::systems(), ECS::threadPool(), [dt](BaseSystem *system) {
+            system->processEvents();
+
+            ProfileScope scope(system->getName(), "update");
+            system->update(dt);
+        });
+
+        // structural changes recorded by the systems, their lifecycle events go out with the flush
+        {
+            ProfileScope scope("ECS", "playbackCommands");
+            ECS::playbackCommands();
+        }
+        ECS::flushEvents();
+
+        ECS::scheduler().run(ECS::systems(), ECS::threadPool(), [](BaseSystem *system) {
+            system->processEvents();
+        });
+
+        ECS::endFrame();
+    }
+};
+
+#endif // RUNNER_H
@@ -0,0 +1,120 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SIMD KERNELS
+// Vectorized integration of position/velocity columns, the kernel is selected at
+// runtime from the instruction sets supported by the cpu. Every kernel computes
+// position + (dt * velocity) with two separate roundings, build with
+// -ffp-contract=off so that the compiler never fuses them and all the paths
+// stay bit exact with the scalar one
+#include <cstddef>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// positions[i] += dt * velocities[i] for i in [0, count)
+typedef void (*IntegrateKernel)(float *positions, const float *velocities, size_t count, float dt);
+
+class Simd
+{
+public:
+    enum Level { Scalar, SSE2, AVX2, AVX512 };
+
+    // best instruction set supported by the cpu
+    static Level detect()
+    {
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f"))
+            return AVX512;
+        if(__builtin_cpu_supports("avx2"))
+            return AVX2;
+        if(__builtin_cpu_supports("sse2"))
+            return SSE2;
+#endif
+        return Scalar;
+    }
+
+    static const char *name(Level level)
+    {
+        static const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+        return names[level];
+    }
+
+    // the kernel for the instruction set, it must be supported by the cpu
+    static IntegrateKernel integrateKernel(Level level)
+    {
+        switch(level) {
+#ifdef SIMD_X86
+        case SSE2: return &integrateSSE2;
+        case AVX2: return &integrateAVX2;
+        case AVX512: return &integrateAVX512;
+#endif
+        default: return &integrateScalar;
+        }
+    }
+
+    // integrate with the best kernel available
+    static void integrate(float *positions, const float *velocities, size_t count, float dt)
+    {
+        static const IntegrateKernel kernel = integrateKernel(detect());
+        kernel(positions, velocities, count, dt);
+    }
+
+    static void integrateScalar(float *positions, const float *velocities, size_t count, float dt)
+    {
+        for(size_t i = 0; i < count; ++i)
+            positions[i] = positions[i] + dt * velocities[i];
+    }
+
+#ifdef SIMD_X86
+    __attribute__((target("sse2")))
+    static void integrateSSE2(float *positions, const float *velocities, size_t count, float dt)
+    {
+        const __m128 step = _mm_set1_ps(dt);
+
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4) {
+            __m128 position = _mm_loadu_ps(positions + i);
+            __m128 velocity = _mm_loadu_ps(velocities + i);
+            _mm_storeu_ps(positions + i, _mm_add_ps(position, _mm_mul_ps(step, velocity)));
+        }
+
+        integrateScalar(positions + i, velocities + i, count - i, dt);
+    }
+
+    __attribute__((target("avx2")))
+    static void integrateAVX2(float *positions, const float *velocities, size_t count, float dt)
+    {
+        const __m256 step = _mm256_set1_ps(dt);
+
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256 position = _mm256_loadu_ps(positions + i);
+            __m256 velocity = _mm256_loadu_ps(velocities + i);
+            _mm256_storeu_ps(positions + i, _mm256_add_ps(position, _mm256_mul_ps(step, velocity)));
+        }
+
+        integrateSSE2(positions + i, velocities + i, count - i, dt);
+    }
+
+    __attribute__((target("avx512f")))
+    static void integrateAVX512(float *positions, const float *velocities, size_t count, float dt)
+    {
+        const __m512 step = _mm512_set1_ps(dt);
+
+        size_t i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m512 position = _mm512_loadu_ps(positions + i);
+            __m512 velocity = _mm512_loadu_ps(velocities + i);
+            _mm512_storeu_ps(positions + i, _mm512_add_ps(position, _mm512_mul_ps(step, velocity)));
+        }
+
+        integrateAVX2(positions + i, velocities + i, count - i, dt);
+    }
+#endif
+};
+
+#endif // SIMD_H
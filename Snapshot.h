@@ -0,0 +1,365 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// WORLD SNAPSHOT
+// Binary checkpoint of the entities and of the listed component types. Every dense array
+// (signatures, generations, entities, packed items or columns) and every page of the
+// sparse indices is written raw, aligned to a cache line. Loading maps the file and copies
+// each array with one bulk copy, nothing is created entity by entity, then the registered
+// queries are refilled with one scan of the signatures. The loaded components are stamped
+// as added and changed in the current tick, no lifecycle event is published for them.
+// Snapshots only load in a build with the same layout: the version, the index parameters,
+// and the id, name and field sizes of every component type must match
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ECS.h"
+
+// bump when the file layout changes
+#ifndef ECS_SNAPSHOT_VERSION
+#define ECS_SNAPSHOT_VERSION 1
+#endif
+
+class Snapshot
+{
+public:
+    // write the entities and the components of the listed types, every non empty container
+    // must be listed. Call it between frames
+    template<class... Components> static bool save(const std::string &path)
+    {
+        std::vector<bool> listed(ECS::components().size(), false);
+        std::initializer_list<int>{ (listType<Components>(listed), 0)... };
+
+        for(size_t type = 0; type < ECS::components().size(); ++type) {
+            BaseContainer *container = ECS::components()[type];
+            if(container && container->size() > 0 && !listed[type])
+                return fail("components of type " + std::to_string(type) + " are not listed");
+        }
+
+        Writer writer;
+        writer.file = fopen(path.c_str(), "wb");
+        if(!writer.file)
+            return fail("cannot open " + path);
+
+        EntityPool &entities = ECS::entities();
+        std::vector<EntityId> free = entities.freeIndices();
+
+        Header header = makeHeader(sizeof...(Components));
+        header.entities = entities.size();
+        header.freeIndices = free.size();
+        writer.write(&header, 1);
+
+        writer.array(entities.items().data(), entities.size());
+        writer.array(entities.generations().data(), entities.size());
+        writer.array(free.data(), free.size());
+
+        std::initializer_list<int>{ (saveType<Components>(writer), 0)... };
+
+        // the size is written last, a truncated file never passes the check
+        header.size = writer.offset;
+        if(writer.ok && fseek(writer.file, 0, SEEK_SET) == 0)
+            writer.write(&header, 1);
+
+        bool ok = writer.ok;
+        if(fclose(writer.file) != 0 || !ok)
+            return fail("cannot write " + path);
+
+        return true;
+    }
+
+    // replace the world with the snapshot, the types must be listed as they were saved.
+    // The world is left untouched if the snapshot is rejected. Call it between frames,
+    // the systems keeping their own state of the previous world are not notified
+    template<class... Components> static bool load(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return fail("cannot open " + path);
+
+        struct stat info;
+        if(fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+            close(fd);
+            return fail(path + " is not a snapshot");
+        }
+
+        size_t size = info.st_size;
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED)
+            return fail("cannot map " + path);
+
+        madvise(data, size, MADV_SEQUENTIAL);
+
+        // a first pass checks the whole file before the world is cleared
+        bool ok = read<Components...>(static_cast<const char*>(data), size, false);
+        if(ok)
+            read<Components...>(static_cast<const char*>(data), size, true);
+
+        munmap(data, size);
+        return ok;
+    }
+
+    // reason of the last failure
+    static const std::string &error() { return lastError(); }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t indexBits;
+        uint32_t pageBits;
+        uint32_t maxComponents;
+        uint32_t signatureSize;
+        uint32_t types;
+        uint64_t entities;
+        uint64_t freeIndices;
+        uint64_t size;
+    };
+
+    struct TypeHeader {
+        char name[64];
+        uint64_t hash;
+        uint32_t type;
+        uint32_t arrays;
+        uint64_t items;
+        uint64_t pages;
+    };
+
+    static const size_t alignment = ECS_CACHE_LINE;
+    static const size_t pageSize = size_t(1) << ECS_SPARSE_PAGE_BITS;
+
+    struct Writer {
+        FILE *file = nullptr;
+        size_t offset = 0;
+        bool ok = true;
+
+        template<class T> void write(const T *data, size_t count)
+        {
+            ok = ok && (count == 0 || fwrite(data, sizeof(T), count, file) == count);
+            offset += sizeof(T) * count;
+        }
+
+        // arrays start on a cache line so that they are aligned in the mapping
+        template<class T> void array(const T *data, size_t count)
+        {
+            static const char zeros[alignment] = {};
+            write(zeros, (alignment - offset % alignment) % alignment);
+            write(data, count);
+        }
+    };
+
+    struct Reader {
+        const char *data;
+        size_t size;
+        size_t offset;
+
+        // next count items, nullptr past the end of the file
+        template<class T> const T *take(size_t count, size_t align = 1)
+        {
+            size_t begin = (offset + align - 1) / align * align;
+            if(begin > size || count > (size - begin) / sizeof(T))
+                return nullptr;
+
+            offset = begin + count * sizeof(T);
+            return reinterpret_cast<const T*>(data + begin);
+        }
+
+        template<class T> const T *array(size_t count) { return take<T>(count, alignment); }
+    };
+
+    static std::string &lastError()
+    {
+        static std::string error;
+        return error;
+    }
+
+    static bool fail(const std::string &error)
+    {
+        lastError() = error;
+        return false;
+    }
+
+    static Header makeHeader(size_t types)
+    {
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "ECSSNAP", 8);
+        header.version = ECS_SNAPSHOT_VERSION;
+        header.indexBits = ECS_ENTITY_INDEX_BITS;
+        header.pageBits = ECS_SPARSE_PAGE_BITS;
+        header.maxComponents = ECS_MAX_COMPONENTS;
+        header.signatureSize = sizeof(Signature);
+        header.types = types;
+
+        return header;
+    }
+
+    template<class T> static void listType(std::vector<bool> &listed)
+    {
+        if(T::type() < listed.size())
+            listed[T::type()] = true;
+    }
+
+    // FNV-1a of the type name and of the size of the type and of its arrays
+    template<class T> static uint64_t typeHash()
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](uint64_t value) {
+            for(int i = 0; i < 8; ++i, value >>= 8)
+                hash = (hash ^ (value & 0xff)) * 1099511628211ull;
+        };
+
+        for(const char *c = T::name(); *c; ++c)
+            mix(static_cast<unsigned char>(*c));
+
+        mix(sizeof(T));
+        mix(alignof(T));
+
+        typename Container<T>::Storage storage;
+        storage.forEachArray([&mix](auto &array) { mix(sizeof(array[0])); });
+
+        return hash;
+    }
+
+    template<class T> static TypeHeader makeTypeHeader(Container<T> *container)
+    {
+        TypeHeader header;
+        memset(&header, 0, sizeof(header));
+        strncpy(header.name, T::name(), sizeof(header.name) - 1);
+        header.hash = typeHash<T>();
+        header.type = T::type();
+        container->storage().forEachArray([&header](auto &) { header.arrays++; });
+        header.items = container->size();
+        container->indices().forEachPage([&header](size_t, const uint32_t*) { header.pages++; });
+
+        return header;
+    }
+
+    template<class T> static void saveType(Writer &writer)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot components must be trivially copyable");
+
+        Container<T> *container = ECS::componentContainer<T>();
+        TypeHeader header = makeTypeHeader(container);
+        writer.array(&header, 1);
+
+        writer.array(container->entities().data(), container->size());
+        container->storage().forEachArray([&writer](auto &array) { writer.array(array.data(), array.size()); });
+
+        std::vector<uint64_t> pages;
+        container->indices().forEachPage([&pages](size_t page, const uint32_t*) { pages.push_back(page); });
+        writer.array(pages.data(), pages.size());
+
+        container->indices().forEachPage([&writer](size_t, const uint32_t *data) { writer.array(data, pageSize); });
+    }
+
+    template<class... Components> static bool read(const char *data, size_t size, bool apply)
+    {
+        Reader reader{data, size, 0};
+
+        const Header &header = *reader.take<Header>(1);
+        Header expected = makeHeader(sizeof...(Components));
+
+        if(memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+            return fail("not a snapshot");
+        if(header.version != expected.version)
+            return fail("snapshot version " + std::to_string(header.version) + ", expected " +
+                        std::to_string(expected.version));
+        if(header.indexBits != expected.indexBits || header.pageBits != expected.pageBits ||
+           header.maxComponents != expected.maxComponents || header.signatureSize != expected.signatureSize)
+            return fail("snapshot written with other index parameters");
+        if(header.types != expected.types)
+            return fail("snapshot of " + std::to_string(header.types) + " component types, " +
+                        std::to_string(expected.types) + " listed");
+        if(header.size != size)
+            return fail("truncated snapshot");
+        if(header.entities == 0 || header.entities - 1 > ECS_ENTITY_INDEX_MASK || header.freeIndices == 0)
+            return fail("corrupted entity table");
+
+        const Signature *signatures = reader.array<Signature>(header.entities);
+        const EntityId *generations = reader.array<EntityId>(header.entities);
+        const EntityId *free = reader.array<EntityId>(header.freeIndices);
+        if(!free)
+            return fail("truncated snapshot");
+
+        if(apply) {
+            for(BaseContainer *container : ECS::components()) {
+                if(container)
+                    container->clear();
+            }
+
+            ECS::entities().assign(signatures, generations, header.entities, free, header.freeIndices);
+        }
+
+        bool ok = true;
+        std::initializer_list<bool>{ (ok = ok && loadType<Components>(reader, apply))... };
+        if(!ok)
+            return false;
+
+        if(apply)
+            ECS::queries().rebuild(ECS::entities());
+
+        return true;
+    }
+
+    template<class T> static bool loadType(Reader &reader, bool apply)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot components must be trivially copyable");
+
+        const TypeHeader *header = reader.array<TypeHeader>(1);
+        if(!header)
+            return fail("truncated snapshot");
+
+        Container<T> *container = ECS::componentContainer<T>();
+        TypeHeader expected = makeTypeHeader(container);
+
+        std::string name(header->name, strnlen(header->name, sizeof(header->name)));
+        if(header->type != expected.type || name != expected.name)
+            return fail("snapshot has " + name + " (" + std::to_string(header->type) + ") where " +
+                        expected.name + " (" + std::to_string(expected.type) + ") is listed");
+        if(header->hash != expected.hash || header->arrays != expected.arrays)
+            return fail("layout of " + name + " changed since the snapshot");
+
+        size_t items = header->items;
+        const EntityId *entities = reader.array<EntityId>(items);
+        if(apply)
+            container->entities().assign(entities, entities + items);
+
+        bool ok = entities != nullptr;
+        container->storage().forEachArray([&](auto &array) {
+            typedef typename std::decay<decltype(array)>::type::value_type Value;
+            const Value *values = reader.array<Value>(items);
+            ok = ok && values;
+            if(apply)
+                array.assign(values, values + items);
+        });
+
+        const uint64_t *pages = reader.array<uint64_t>(header->pages);
+        ok = ok && pages;
+        for(size_t i = 0; ok && i < header->pages; ++i) {
+            const uint32_t *page = reader.array<uint32_t>(pageSize);
+            ok = page && pages[i] <= (ECS_ENTITY_INDEX_MASK >> ECS_SPARSE_PAGE_BITS);
+            if(ok && apply)
+                memcpy(container->indices().page(pages[i]), page, pageSize * sizeof(uint32_t));
+        }
+
+        if(!ok)
+            return fail("truncated or corrupted snapshot");
+
+        if(apply)
+            container->stampItems(ECS::changeTicks().current());
+
+        return true;
+    }
+};
+
+#endif // SNAPSHOT_H
@@ -1,39 +1,48 @@
 #include "CollisionSystem.h"
 
-#include "Events/EntityMoved.h"
 #include "Events/Collision.h"
-#include "Components/GraphicComponent.h"
 
-CollisionSystem::CollisionSystem()
+// radius of the bodies, the entities are spawned in the unit square
+const float BODY_RADIUS = 0.001f;
+
+// a body moves up to about 0.017 per tick on each axis, with cells this wide most bodies stay
+// in their cell for a tick and a cell holds about 40 bodies at the spawn density. Cells as
+// narrow as the bodies would make every body change cell on every tick
+const float CELL_SIZE = 0.02f;
+
+CollisionSystem::CollisionSystem() : m_tick(0), m_broadphase(ECS::threadPool(), BODY_RADIUS, CELL_SIZE)
 {
-    subscribeTo<EntityMoved>();
-    subscribeTo<ItemCreated<PhysicsComponent>>();
+    subscribeTo<ItemsDeleted<PhysicsComponent>>();
 }
 
-void CollisionSystem::handleEvent(BaseEvent *event)
+void CollisionSystem::update(float)
 {
-    const EventType MOVED = EntityMoved::type();
-    const EventType CREATED = ItemCreated<PhysicsComponent>::type();
+    // only the bodies moved or created since the last update are rehashed
+    m_moved.clear();
+    ECS::changed<PhysicsComponent>(m_tick, m_moved);
+
+    for(EntityId id : m_moved) {
+        auto p = ECS::component<const PhysicsComponent>(id);
+        if(p)
+            m_broadphase.update(id, p->position);
+    }
 
-    if(event->getType() == MOVED) {
-        EntityMoved *moved = static_cast<EntityMoved*>(event);
-        std::vector<std::pair<EntityId, EntityId>> collisions;
+    // allocated in the frame arena and moved into the event
+    ArenaVector<CollisionPair> collisions;
+    m_broadphase.pairs(collisions);
 
-        for(struct Movement& movement : moved->movements) {
-            //std::cout << "(Collision) Handling move event of component " << movement.id << std::endl;
-            if(rand()%5 + 1 == 1)
-                collisions.push_back(std::pair<EntityId, EntityId>(movement.id, movement.id + 1));
-        }
+    if(collisions.size())
+        publishEvent<Collision>(collisions);
+}
 
-        if(collisions.size())
-            publishEvent(new Collision(collisions));
-    }
+void CollisionSystem::handleEvent(BaseEvent *event)
+{
+    const EventType DELETED = ItemsDeleted<PhysicsComponent>::type();
 
-    if(event->getType() == CREATED) {
-        ItemCreated<PhysicsComponent> *created = static_cast<ItemCreated<PhysicsComponent>*>(event);
-        PhysicsComponent *c = &(created->item);
+    if(event->getType() == DELETED) {
+        ItemsDeleted<PhysicsComponent> *deleted = static_cast<ItemsDeleted<PhysicsComponent>*>(event);
 
-        // handle the deleted component
-        //std::cout << "(Collision) Handling created event of physics component " << c->id() << std::endl;
+        for(EntityId id : deleted->ids)
+            m_broadphase.remove(id);
     }
 }
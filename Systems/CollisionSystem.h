@@ -3,13 +3,22 @@
 
 #include "ECS.h"
 #include "Components/PhysicsComponent.h"
+#include "Systems/SpatialHash.h"
 
-class CollisionSystem : public System<CollisionSystem>
+class CollisionSystem : public System<CollisionSystem, Read<PhysicsComponent>>
 {
 public:
     CollisionSystem();
 
+    void update(float dt);
     void handleEvent(BaseEvent* event);
+
+private:
+    // next change tick to read and the entities moved since the last update
+    uint32_t m_tick;
+    std::vector<EntityId> m_moved;
+
+    SpatialHash m_broadphase;
 };
 
 #endif // COLLISIONSYSTEM_H
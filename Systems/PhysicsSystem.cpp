@@ -1,7 +1,8 @@
 #include "PhysicsSystem.h"
 
 #include <iostream>
-#include <SDL2/SDL.h>
+
+#include "Simd.h"
 
 #include "Components/PhysicsComponent.h"
 #include "Components/GraphicComponent.h"
@@ -10,66 +11,29 @@
 #include "Components/LightComponent.h"
 
 #include "Events/Collision.h"
-#include "Events/EntityMoved.h"
 
 using namespace std;
 
 PhysicsSystem::PhysicsSystem()
 {
-    m_entities = ECS::entitiesWithComponents<GraphicComponent, PhysicsComponent>();
-    m_components = ECS::components<PhysicsComponent>();
+    m_components = ECS::componentContainer<PhysicsComponent>();
 
     subscribeTo<Collision>();
 }
 
 void PhysicsSystem::update(float dt)
 {
-    std::vector<Movement> movements;
-
-    unsigned int time, elapsed;
-
-    time = SDL_GetTicks();
-    for(const size_t &entityId : *m_entities) {
-        PhysicsComponent *p = ECS::component<PhysicsComponent>(entityId);
-
-        glm::vec3 position = p->position;
-        position += dt*p->velocity;
-
-        if(rand()%10 + 1 == 1) {
-            struct Movement movement = {entityId, p->position, position};
-            movements.push_back(movement);
-        }
-
-        p->position = position;
-    }
-
-    elapsed = SDL_GetTicks() - time;
-    cout << "(Physics) Time to process "<< m_entities->size() << " entities from tree: " << elapsed << "ms" <<endl;
-
-    if(movements.size())
-        publishEvent(new EntityMoved(movements));
-
-    int processed = 0;
-    time = SDL_GetTicks();
-    for(PhysicsComponent &p : *m_components)
-    {
-        // skip dummy components
-        if(!p.isValid())
-            continue;
+    // every body is integrated once, the drawn ones are synced by the view of the rendering system.
+    // The position and velocity columns are flat arrays of floats
+    float *positions = reinterpret_cast<float*>(m_components->storage().column(&PhysicsComponent::position));
+    const float *velocities = reinterpret_cast<float*>(m_components->storage().column(&PhysicsComponent::velocity));
 
-        glm::vec3 position = p.position;
-        position += dt*p.velocity;
-        p.position = position;
+    uint32_t tick = ECS::changeTicks().current();
 
-        if(rand()%10 + 1 == 1) {
-            struct Movement movement = {p.id(), p.position, position};
-            movements.push_back(movement);
-        }
-
-        processed++;
-    }
-    elapsed = SDL_GetTicks() - time;
-    cout << "(Physics) Time to process " << processed <<" components: " << elapsed << "ms" <<endl;
+    parallelFor(ECS::threadPool(), m_components->size(), ECS_CACHE_LINE, [=](size_t begin, size_t end) {
+        Simd::integrate(positions + 3*begin, velocities + 3*begin, 3*(end - begin), dt);
+        m_components->setChanged(begin, end, tick);
+    });
 }
 
 void PhysicsSystem::handleEvent(BaseEvent *event)
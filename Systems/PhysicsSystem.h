@@ -4,7 +4,7 @@
 #include "ECS.h"
 #include "Components/PhysicsComponent.h"
 
-class PhysicsSystem : public System<PhysicsSystem>
+class PhysicsSystem : public System<PhysicsSystem, Write<PhysicsComponent>>
 {
 public:
     PhysicsSystem();
@@ -13,8 +13,7 @@ public:
     void handleEvent(BaseEvent* event);
 
 private:
-    EntitySet *m_entities;
-    std::vector<PhysicsComponent> *m_components;
+    Container<PhysicsComponent> *m_components;
 };
 
 #endif // PHYSICSSYSTEM_H
@@ -1,66 +1,30 @@
 #include "RenderingSystem.h"
 
-#include <SDL2/SDL.h>
-#include <iostream>
-
 #include "Events/Collision.h"
-#include "Events/EntityMoved.h"
 #include "Components/PhysicsComponent.h"
 
-using namespace std;
-
-RenderingSystem::RenderingSystem()
+void RenderingSystem::update(float)
 {
-    m_entities = ECS::entitiesWithComponents<GraphicComponent, PhysicsComponent>();
-    m_components = ECS::components<GraphicComponent>();
+    m_next.clear();
+    ECS::view<const PhysicsComponent, const GraphicComponent>().each([&](EntityId id, PhysicsComponent::Ref p, const GraphicComponent &) {
+        // a body drawn for the first time has no previous tick to blend from
+        uint32_t slot = m_slots[entityIndex(id)];
+        bool known = slot < m_bodies.size() && m_bodies[slot].id == id;
+        m_next.push_back(Body{id, known ? m_bodies[slot].current : p.position, p.position});
+    });
+
+    m_bodies.swap(m_next);
+    for(size_t i = 0; i < m_bodies.size(); ++i)
+        m_slots.at(entityIndex(m_bodies[i].id)) = static_cast<uint32_t>(i);
 }
 
-void RenderingSystem::update(float dt)
+void RenderingSystem::draw(float alpha)
 {
-    unsigned int time, elapsed;
-    int processed = 0;
-
-//    vector<EntityId> tmp;
-//    tmp.insert(tmp.end(), m_entities->begin(), m_entities->end());
-
-    time = SDL_GetTicks();
-    //for(EntitySet::iterator it = m_entities->begin(); it != m_entities->end(); ++it) {
-    for(const EntityId &id : *m_entities) {
-    //for(size_t id : tmp) {
-        PhysicsComponent *p = ECS::component<PhysicsComponent>(id);
-        GraphicComponent *g = ECS::component<GraphicComponent>(id);
-        // draw
-
-        processed++;
-    }
-    elapsed = SDL_GetTicks() - time;
-    cout << "(Rendering) Time to process "<< processed << " entities from tree: " << elapsed << "ms" <<endl;
-
-    processed = 0;
-    time = SDL_GetTicks();
-    for(GraphicComponent &g : *m_components)
-    {
-        //PhysicsComponent *p = ECS::component<PhysicsComponent>(g.id());
-        if(g.isValid()) {
-            // draw
-            processed++;
-        }
+    m_positions.resize(m_bodies.size());
+    for(size_t i = 0; i < m_bodies.size(); ++i) {
+        const Body &body = m_bodies[i];
+        m_positions[i] = body.previous + alpha * (body.current - body.previous);
     }
-    elapsed = SDL_GetTicks() - time;
-    cout << "(Rendering) Time to process " << processed <<" components: " << elapsed << "ms" <<endl;
 
-    processed = 0;
-    int entities = 0;
-    time = SDL_GetTicks();
-    for(ComponentList &list : ECS::entities().items()) {
-        PhysicsComponent *p = ECS::component<PhysicsComponent>(processed);
-        if(p->isValid()) {
-            GraphicComponent *g = ECS::component<GraphicComponent>(processed);
-            if(g->isValid())
-                entities++;
-        }
-        processed++;
-    }
-    elapsed = SDL_GetTicks() - time;
-    cout << "(Rendering) Time to process " << entities <<" entities: " << elapsed << "ms" <<endl;
+    // draw
 }
@@ -1,19 +1,36 @@
 #ifndef RENDERINGSYSTEM_H
 #define RENDERINGSYSTEM_H
 
+#include <vector>
+
 #include "ECS.h"
 #include "Components/GraphicComponent.h"
+#include "Components/PhysicsComponent.h"
 
-class RenderingSystem :  public System<RenderingSystem>
+class RenderingSystem :  public System<RenderingSystem, Read<GraphicComponent, PhysicsComponent>>
 {
 public:
-    RenderingSystem();
-
+    // keep the positions of the drawn bodies at the last two ticks
     void update(float dt);
 
+    // draw the bodies between the last two ticks, alpha is the one of the runner
+    void draw(float alpha);
+
 private:
-    EntitySet *m_entities;
-    std::vector<GraphicComponent> *m_components;
+    struct Body {
+        EntityId id;
+        glm::vec3 previous;
+        glm::vec3 current;
+    };
+
+    // bodies of the last tick and their slots by entity index, the slots of the bodies
+    // gone since are stale and checked against the id
+    std::vector<Body> m_bodies;
+    std::vector<Body> m_next;
+    SparseIndex m_slots;
+
+    // blended positions handed to the drawing code
+    std::vector<glm::vec3> m_positions;
 };
 
 #endif // RENDERINGSYSTEM_H
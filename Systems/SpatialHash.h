@@ -0,0 +1,328 @@
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "ECS.h"
+#include "Events/Collision.h"
+
+// Uniform grid broadphase, bodies are spheres of the same radius hashed to cubic cells at
+// least as wide as their diameter, so overlapping bodies are in the same or in neighbouring
+// cells. Moving a body only touches the cells it leaves and enters. Pairs are generated
+// concurrently, every cell is tested against itself and half of its neighbours so that
+// each pair is found once
+class SpatialHash
+{
+public:
+    SpatialHash(ThreadPool &pool, float radius, float cellSize = 0.0f) :
+        m_pool(pool),
+        m_diameter(2.0f * radius),
+        m_cellSize(std::max(cellSize, 2.0f * radius)),
+        m_pairs(pool) {}
+
+    size_t size() { return m_locations.size(); }
+
+    // number of occupied cells
+    size_t cells() { return m_cells.size(); }
+
+    // insert the body of the entity or move it to the position
+    void update(EntityId id, const glm::vec3 &position)
+    {
+        int x, y, z;
+        cellCoordinates(position, x, y, z);
+
+        uint32_t &index = m_indices.at(entityIndex(id));
+        if(index == SparseIndex::npos) {
+            index = m_locations.size();
+            m_locations.push_back(Location{id, 0, 0});
+            addToCell(index, Body{id, position}, x, y, z);
+            return;
+        }
+
+        Location &location = m_locations[index];
+        location.id = id;
+
+        const Cell &cell = m_cells[location.cell];
+        if(cell.x != x || cell.y != y || cell.z != z) {
+            removeFromCell(index);
+            addToCell(index, Body{id, position}, x, y, z);
+        } else {
+            m_cells[location.cell].bodies[location.slot] = Body{id, position};
+        }
+    }
+
+    void remove(EntityId id)
+    {
+        uint32_t index = m_indices[entityIndex(id)];
+        if(index == SparseIndex::npos || m_locations[index].id != id)
+            return;
+
+        removeFromCell(index);
+
+        // swap the last location in the hole
+        uint32_t last = m_locations.size() - 1;
+        if(index != last) {
+            m_locations[index] = m_locations[last];
+            m_indices.at(entityIndex(m_locations[index].id)) = index;
+        }
+
+        m_locations.pop_back();
+        m_indices.at(entityIndex(id)) = SparseIndex::npos;
+    }
+
+    // append the overlapping pairs, the smaller id first and sorted so that the output
+    // does not depend on how the cells were split between the threads
+    void pairs(ArenaVector<CollisionPair> &pairs)
+    {
+        m_pairs.forEach([](std::vector<CollisionPair> &list) { list.clear(); });
+
+        parallelFor(m_pool, m_cells.size(), 1, [this](size_t begin, size_t end) {
+            std::vector<CollisionPair> &list = m_pairs.local();
+            for(size_t i = begin; i < end; ++i)
+                cellPairs(m_cells[i], list);
+        });
+
+        size_t count = pairs.size();
+        m_pairs.forEach([&count](std::vector<CollisionPair> &list) { count += list.size(); });
+
+        size_t first = pairs.size();
+        pairs.reserve(count);
+        m_pairs.forEach([&pairs](std::vector<CollisionPair> &list) {
+            pairs.insert(pairs.end(), list.begin(), list.end());
+        });
+
+        std::sort(pairs.begin() + first, pairs.end());
+    }
+
+    void clear()
+    {
+        m_locations.clear();
+        m_indices.clear();
+        m_cells.clear();
+        m_slots.clear();
+    }
+
+private:
+    // the bodies are stored in their cells so that testing a cell reads contiguous memory
+    struct Body {
+        EntityId id;
+        glm::vec3 position;
+    };
+
+    struct Cell {
+        int x, y, z;
+        std::vector<Body> bodies;
+    };
+
+    struct Location {
+        EntityId id;
+        uint32_t cell;
+        uint32_t slot;
+    };
+
+    ThreadPool &m_pool;
+    float m_diameter;
+    float m_cellSize;
+
+    std::vector<Location> m_locations;
+    SparseIndex m_indices;
+
+    // open addressing table of the occupied cells, keys fit in 63 bits so all ones is free
+    struct Slot {
+        uint64_t key;
+        uint32_t cell;
+    };
+
+    static const uint64_t FREE = ~uint64_t(0);
+
+    // cell of the bodies with a non finite position, past the clamped coordinates
+    static const int INVALID_CELL = (1 << 20) - 1;
+
+    std::vector<Cell> m_cells;
+    std::vector<Slot> m_slots;
+
+    PerThread<std::vector<CollisionPair>> m_pairs;
+
+    // coordinates are clamped to 21 bits each to pack them in a key. A NaN or infinite
+    // position would not survive the clamp, the body goes to the invalid cell where its
+    // distances are never finite so it overlaps nothing
+    void cellCoordinates(const glm::vec3 &position, int &x, int &y, int &z)
+    {
+        if(!std::isfinite(position.x) || !std::isfinite(position.y) || !std::isfinite(position.z)) {
+            x = y = z = INVALID_CELL;
+            return;
+        }
+
+        const float limit = (1 << 20) - 2;
+        x = static_cast<int>(std::floor(std::max(-limit, std::min(limit, position.x / m_cellSize))));
+        y = static_cast<int>(std::floor(std::max(-limit, std::min(limit, position.y / m_cellSize))));
+        z = static_cast<int>(std::floor(std::max(-limit, std::min(limit, position.z / m_cellSize))));
+    }
+
+    static uint64_t cellKey(int x, int y, int z)
+    {
+        const uint64_t mask = (uint64_t(1) << 21) - 1;
+        return (uint64_t(x) & mask) << 42 | (uint64_t(y) & mask) << 21 | (uint64_t(z) & mask);
+    }
+
+    size_t slotOf(uint64_t key) const
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key & (m_slots.size() - 1);
+    }
+
+    // cell index of the key or npos
+    uint32_t findCell(uint64_t key) const
+    {
+        if(m_slots.empty())
+            return SparseIndex::npos;
+
+        for(size_t i = slotOf(key); ; i = (i + 1) & (m_slots.size() - 1)) {
+            if(m_slots[i].key == key)
+                return m_slots[i].cell;
+            if(m_slots[i].key == FREE)
+                return SparseIndex::npos;
+        }
+    }
+
+    uint32_t &insertCell(uint64_t key)
+    {
+        // kept at most half full
+        if(2 * (m_cells.size() + 1) > m_slots.size()) {
+            std::vector<Slot> slots(std::max<size_t>(64, 2 * m_slots.size()), Slot{FREE, 0});
+            m_slots.swap(slots);
+            for(const Slot &slot : slots) {
+                if(slot.key != FREE)
+                    insertCell(slot.key) = slot.cell;
+            }
+        }
+
+        size_t i = slotOf(key);
+        while(m_slots[i].key != FREE)
+            i = (i + 1) & (m_slots.size() - 1);
+
+        m_slots[i].key = key;
+        return m_slots[i].cell;
+    }
+
+    // shift back the following entries of the probe sequence to fill the hole
+    void eraseCell(uint64_t key)
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = slotOf(key);
+        while(m_slots[i].key != key)
+            i = (i + 1) & mask;
+
+        for(size_t j = (i + 1) & mask; m_slots[j].key != FREE; j = (j + 1) & mask) {
+            size_t home = slotOf(m_slots[j].key);
+            if(((j - home) & mask) >= ((j - i) & mask)) {
+                m_slots[i] = m_slots[j];
+                i = j;
+            }
+        }
+
+        m_slots[i].key = FREE;
+    }
+
+    void addToCell(uint32_t index, const Body &body, int x, int y, int z)
+    {
+        uint64_t key = cellKey(x, y, z);
+
+        uint32_t cellIndex = findCell(key);
+        if(cellIndex == SparseIndex::npos) {
+            cellIndex = m_cells.size();
+            insertCell(key) = cellIndex;
+            m_cells.push_back(Cell{x, y, z, std::vector<Body>()});
+        }
+
+        Cell &cell = m_cells[cellIndex];
+        m_locations[index].cell = cellIndex;
+        m_locations[index].slot = cell.bodies.size();
+        cell.bodies.push_back(body);
+    }
+
+    // empty cells are swapped with the last one so that only occupied cells are visited
+    void removeFromCell(uint32_t index)
+    {
+        uint32_t cellIndex = m_locations[index].cell;
+        Cell &cell = m_cells[cellIndex];
+
+        uint32_t slot = m_locations[index].slot;
+        cell.bodies[slot] = cell.bodies.back();
+        m_locations[m_indices[entityIndex(cell.bodies[slot].id)]].slot = slot;
+        cell.bodies.pop_back();
+
+        if(!cell.bodies.empty())
+            return;
+
+        eraseCell(cellKey(cell.x, cell.y, cell.z));
+
+        uint32_t last = m_cells.size() - 1;
+        if(cellIndex != last) {
+            std::swap(m_cells[cellIndex], m_cells[last]);
+            const Cell &moved = m_cells[cellIndex];
+
+            size_t i = slotOf(cellKey(moved.x, moved.y, moved.z));
+            while(m_slots[i].key != cellKey(moved.x, moved.y, moved.z))
+                i = (i + 1) & (m_slots.size() - 1);
+            m_slots[i].cell = cellIndex;
+
+            for(const Body &body : moved.bodies)
+                m_locations[m_indices[entityIndex(body.id)]].cell = cellIndex;
+        }
+
+        m_cells.pop_back();
+    }
+
+    void testPair(const Body &a, const Body &b, std::vector<CollisionPair> &pairs)
+    {
+        glm::vec3 d = a.position - b.position;
+        if(d.x*d.x + d.y*d.y + d.z*d.z < m_diameter*m_diameter)
+            pairs.push_back(a.id < b.id ? CollisionPair(a.id, b.id) : CollisionPair(b.id, a.id));
+    }
+
+    void cellPairs(const Cell &cell, std::vector<CollisionPair> &pairs)
+    {
+        // the 13 neighbours following the cell in (x, y, z) order
+        static const int offsets[13][3] = {
+            {0, 0, 1},
+            {0, 1, -1}, {0, 1, 0}, {0, 1, 1},
+            {1, -1, -1}, {1, -1, 0}, {1, -1, 1},
+            {1, 0, -1}, {1, 0, 0}, {1, 0, 1},
+            {1, 1, -1}, {1, 1, 0}, {1, 1, 1}
+        };
+
+        for(size_t i = 0; i < cell.bodies.size(); ++i) {
+            for(size_t j = i + 1; j < cell.bodies.size(); ++j)
+                testPair(cell.bodies[i], cell.bodies[j], pairs);
+        }
+
+        // the neighbours are looked up after touching all their slots so that the cache
+        // misses overlap
+        uint64_t keys[13];
+        for(int i = 0; i < 13; ++i) {
+            keys[i] = cellKey(cell.x + offsets[i][0], cell.y + offsets[i][1], cell.z + offsets[i][2]);
+            __builtin_prefetch(&m_slots[slotOf(keys[i])]);
+        }
+
+        for(uint64_t key : keys) {
+            uint32_t index = findCell(key);
+            if(index == SparseIndex::npos)
+                continue;
+
+            const Cell &neighbour = m_cells[index];
+            for(const Body &a : cell.bodies) {
+                for(const Body &b : neighbour.bodies)
+                    testPair(a, b, pairs);
+            }
+        }
+    }
+};
+
+#endif // SPATIALHASH_H
@@ -1,3 +1,5 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "Systems/CollisionSystem.h"
@@ -10,13 +12,65 @@
 #include "Components/HealthComponent.h"
 #include "Components/LightComponent.h"
 
+#include "Snapshot.h"
+
+#ifdef ECS_HEADLESS
+#include "Runner.h"
+#else
 #include "Engine.h"
+#endif
 
 using namespace std;
 
-int main()
+#ifndef ECS_HEADLESS
+// draws the bodies between the last two ticks of the simulation
+class Game : public Engine
+{
+protected:
+    void draw() override { ECS::createSystem<RenderingSystem>()->draw(alpha()); }
+};
+#endif
+
+static bool saveWorld(const char *path)
+{
+    return Snapshot::save<GraphicComponent, MagneticComponent, HealthComponent, LightComponent, PhysicsComponent>(path);
+}
+
+static bool loadWorld(const char *path)
 {
-    Engine engine;
+    return Snapshot::load<GraphicComponent, MagneticComponent, HealthComponent, LightComponent, PhysicsComponent>(path);
+}
+
+// usage: ECS [ticks] [--realtime | --unlimited] [--profile trace.json] [--load world.bin]
+// [--save world.bin], without ticks it runs until the window is closed. The window runs in
+// real time by default, the headless build as fast as possible. The world is restored from
+// the snapshot given to --load instead of being generated, and written to --save on exit
+int main(int argc, char **argv)
+{
+#ifdef ECS_HEADLESS
+    Runner engine;
+#else
+    Game engine;
+#endif
+
+    uint64_t ticks = 0;
+    const char *trace = nullptr;
+    const char *load = nullptr;
+    const char *save = nullptr;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--realtime") == 0)
+            engine.setPacing(Runner::RealTime);
+        else if(strcmp(argv[i], "--unlimited") == 0)
+            engine.setPacing(Runner::Unlimited);
+        else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            trace = argv[++i];
+        else if(strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+            load = argv[++i];
+        else if(strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+            save = argv[++i];
+        else
+            ticks = strtoull(argv[i], nullptr, 10);
+    }
 
     printf("Component Types:\n %s(%d)\n %s(%d)\n %s(%d)\n %s(%d)\n %s(%d)\n",
            GraphicComponent::name(), GraphicComponent::type(),
@@ -33,37 +87,60 @@ int main()
     ECS::createSystem<CollisionSystem>();
     ECS::createSystem<RenderingSystem>();
 
-    boost::container::flat_set<uint> s;
-    vector<uint> v;
-
-    // create entities
-    uint MAX_COMPONENTS = 100000;
-    cout << "Creating " << MAX_COMPONENTS << " entities...\n" << endl;
-    for(uint i=0; i<MAX_COMPONENTS; i++)
-    {
-        size_t id = ECS::createEntity();
-
-        //if(rand()%5+1 == 1)
-            ECS::createComponent<GraphicComponent>(id);
-        if(rand()%5+1 == 2)
-            ECS::createComponent<MagneticComponent>(id);
-        if(rand()%5+1 == 3)
-            ECS::createComponent<HealthComponent>(id, 5);
-        if(rand()%5+1 == 4)
-            ECS::createComponent<LightComponent>(id);
-
-        PhysicsComponent *p = ECS::createComponent<PhysicsComponent>(id);
-        p->position.x = rand()/static_cast<float>(RAND_MAX);
-        p->position.y = rand()/static_cast<float>(RAND_MAX);
-        p->velocity.x = rand()/static_cast<float>(RAND_MAX);
-        p->velocity.y = rand()/static_cast<float>(RAND_MAX);
-        p->mass = rand()/static_cast<float>(RAND_MAX);
-
-        s.insert(i);
-        v.push_back(i);
+    if(load) {
+        cout << "Loading " << load << "...\n" << endl;
+        if(!loadWorld(load)) {
+            printf("Cannot load %s: %s\n", load, Snapshot::error().c_str());
+            return 1;
+        }
+    } else {
+        // create entities
+        uint MAX_COMPONENTS = 100000;
+        cout << "Creating " << MAX_COMPONENTS << " entities...\n" << endl;
+        std::vector<EntityId> entities = ECS::createEntities(MAX_COMPONENTS);
+        std::vector<EntityId> magnetic, health, light;
+
+        for(EntityId id : entities)
+        {
+            if(rand()%5+1 == 2)
+                magnetic.push_back(id);
+            if(rand()%5+1 == 3)
+                health.push_back(id);
+            if(rand()%5+1 == 4)
+                light.push_back(id);
+        }
+
+        ECS::createComponents<GraphicComponent>(entities);
+        ECS::createComponents<MagneticComponent>(magnetic);
+        ECS::createComponents<HealthComponent>(health, [](HealthComponent &h) { h.health = 5; });
+        ECS::createComponents<LightComponent>(light);
+
+        ECS::createComponents<PhysicsComponent>(entities, [](PhysicsComponent &p) {
+            p.position.x = rand()/static_cast<float>(RAND_MAX);
+            p.position.y = rand()/static_cast<float>(RAND_MAX);
+            p.velocity.x = rand()/static_cast<float>(RAND_MAX);
+            p.velocity.y = rand()/static_cast<float>(RAND_MAX);
+            p.mass = rand()/static_cast<float>(RAND_MAX);
+        });
     }
 
-    return engine.run();
+    ECS::profiler().enable(trace != nullptr);
+    engine.run(ticks);
+
+    printf("%llu ticks, %llu frames in %.2fs, %llu slow frames, %llu dropped ticks\n",
+           (unsigned long long)engine.ticks(), (unsigned long long)engine.frames(), engine.elapsed(),
+           (unsigned long long)engine.slowFrames(), (unsigned long long)engine.droppedTicks());
+
+    if(trace) {
+        ECS::profiler().report(stdout);
+        if(!ECS::profiler().writeTrace(trace))
+            printf("Cannot write %s\n", trace);
+    }
+
+    if(save && !saveWorld(save))
+        printf("Cannot save %s: %s\n", save, Snapshot::error().c_str());
+
+    return 0;
 }
 
 